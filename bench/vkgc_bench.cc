@@ -0,0 +1,673 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+// Microbenchmarks for every public entry point of the GC, running on the fake
+// device. Results are written as JSON, so that they can be compared between
+// builds, e.g. after swapping containers. On Linux, cache misses are counted
+// too, if the kernel allows it.
+//
+// Usage: vkgc_bench [--quick] [--filter <substring>] [--out <file.json>]
+#include "vkgc_fake.hh"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+uint64_t elapsed_ns(clock_type::time_point start, clock_type::time_point end)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+struct param
+{
+    const char* name;
+    uint64_t value;
+};
+
+struct result
+{
+    std::string name;
+    std::vector<param> params;
+    // 'items' counts the work done by all calls, e.g. dependencies added by
+    // depend_many() or nodes destroyed by a cascade.
+    uint64_t ops;
+    uint64_t items;
+    uint64_t total_ns;
+    uint64_t cache_misses;
+    std::vector<uint64_t> latencies;
+};
+
+struct options
+{
+    bool quick = false;
+    const char* filter = nullptr;
+    const char* out = nullptr;
+};
+
+// One GC on its own fake device. Handles are just unique fake pointers.
+struct fixture
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc;
+    uintptr_t handle_counter = 0;
+
+    fixture()
+    : gc(dev.device(), dev.dispatch())
+    {
+        // Benchmarks leave things behind on purpose, don't report them.
+        gc.set_leak_handler([](const vkgc::garbage_collector::leak_report&){});
+    }
+
+    void* handle()
+    {
+        handle_counter += 16;
+        return (void*)handle_counter;
+    }
+
+    std::vector<void*> handles(size_t count)
+    {
+        std::vector<void*> res(count);
+        for(void*& h: res)
+            h = handle();
+        return res;
+    }
+};
+
+// Counts the cache misses of this thread with perf_event_open(). Where that's
+// not available, e.g. on other platforms or in VMs without a PMU,
+// available() is false and the counts are left out.
+class cache_miss_counter
+{
+public:
+    cache_miss_counter()
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    cache_miss_counter(const cache_miss_counter&) = delete;
+    cache_miss_counter& operator=(const cache_miss_counter&) = delete;
+
+    ~cache_miss_counter()
+    {
+#ifdef __linux__
+        if(fd >= 0)
+            close(fd);
+#endif
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if(fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+#ifdef __linux__
+        if(fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if(read(fd, &count, sizeof(count)) != sizeof(count))
+            count = 0;
+#endif
+        return count;
+    }
+
+private:
+    int fd = -1;
+};
+
+class runner
+{
+public:
+    runner(const options& opt): opt(opt) {}
+
+    bool quick() const { return opt.quick; }
+
+    // Sets up a fresh fixture with 'setup' for each of 'reps' repetitions, and
+    // times each of the 'ops' calls to 'op'. Setup and teardown are not
+    // timed.
+    template<typename Setup, typename Op>
+    void run(
+        const char* name,
+        std::vector<param> params,
+        unsigned reps,
+        size_t ops,
+        uint64_t items_per_op,
+        Setup setup,
+        Op op
+    ){
+        if(opt.filter && !std::strstr(name, opt.filter))
+            return;
+
+        result res;
+        res.name = name;
+        res.params = params;
+        res.ops = 0;
+        res.items = 0;
+        res.total_ns = 0;
+        res.cache_misses = 0;
+        res.latencies.reserve(reps * ops);
+        for(unsigned r = 0; r < reps; ++r)
+        {
+            auto f = setup();
+            misses.start();
+            auto start = clock_type::now();
+            for(size_t i = 0; i < ops; ++i)
+            {
+                auto call_start = clock_type::now();
+                op(*f, i);
+                res.latencies.push_back(elapsed_ns(call_start, clock_type::now()));
+            }
+            res.total_ns += elapsed_ns(start, clock_type::now());
+            res.cache_misses += misses.stop();
+            res.ops += ops;
+            res.items += ops * items_per_op;
+        }
+        std::fprintf(
+            stderr, "%-24s %10.1f ns/op", describe(res).c_str(),
+            double(res.total_ns) / res.ops
+        );
+        if(misses.available())
+            std::fprintf(stderr, " %10.1f misses/op", double(res.cache_misses) / res.ops);
+        std::fprintf(stderr, "\n");
+        results.push_back(std::move(res));
+    }
+
+    void write_json(std::FILE* f) const
+    {
+        std::fprintf(f, "{\n  \"timer_overhead_ns\": %llu,\n", (unsigned long long)timer_overhead());
+        std::fprintf(f, "  \"quick\": %s,\n  \"results\": [\n", opt.quick ? "true" : "false");
+        for(size_t i = 0; i < results.size(); ++i)
+        {
+            const result& res = results[i];
+            std::vector<uint64_t> lat = res.latencies;
+            std::sort(lat.begin(), lat.end());
+            double seconds = res.total_ns * 1e-9;
+            std::fprintf(f, "    {\"name\": \"%s\", \"params\": {", res.name.c_str());
+            for(size_t j = 0; j < res.params.size(); ++j)
+            {
+                std::fprintf(
+                    f, "%s\"%s\": %llu", j == 0 ? "" : ", ", res.params[j].name,
+                    (unsigned long long)res.params[j].value
+                );
+            }
+            std::fprintf(
+                f, "}, \"ops\": %llu, \"items\": %llu, \"seconds\": %.9f, "
+                "\"ops_per_sec\": %.1f, \"items_per_sec\": %.1f, \"ns_per_op\": %.1f, "
+                "\"latency_ns\": {\"min\": %llu, \"p50\": %llu, \"p90\": %llu, "
+                "\"p99\": %llu, \"max\": %llu}",
+                (unsigned long long)res.ops, (unsigned long long)res.items, seconds,
+                res.ops / seconds, res.items / seconds, double(res.total_ns) / res.ops,
+                (unsigned long long)percentile(lat, 0),
+                (unsigned long long)percentile(lat, 0.5),
+                (unsigned long long)percentile(lat, 0.9),
+                (unsigned long long)percentile(lat, 0.99),
+                (unsigned long long)percentile(lat, 1)
+            );
+            if(misses.available())
+                std::fprintf(f, ", \"cache_misses\": %llu", (unsigned long long)res.cache_misses);
+            std::fprintf(f, "}%s\n", i + 1 == results.size() ? "" : ",");
+        }
+        std::fprintf(f, "  ]\n}\n");
+    }
+
+private:
+    static uint64_t percentile(const std::vector<uint64_t>& sorted, double p)
+    {
+        if(sorted.empty()) return 0;
+        return sorted[std::min(sorted.size() - 1, size_t(p * sorted.size()))];
+    }
+
+    // Each timed call also pays for two clock reads. This is reported so that
+    // very cheap calls can be interpreted correctly.
+    static uint64_t timer_overhead()
+    {
+        const unsigned n = 100000;
+        auto start = clock_type::now();
+        for(unsigned i = 0; i < n; ++i)
+        {
+            auto t = clock_type::now();
+            (void)t;
+        }
+        return elapsed_ns(start, clock_type::now()) / n;
+    }
+
+    static std::string describe(const result& res)
+    {
+        std::string s = res.name;
+        for(const param& p: res.params)
+            s += " " + std::string(p.name) + "=" + std::to_string(p.value);
+        return s;
+    }
+
+    options opt;
+    cache_miss_counter misses;
+    std::vector<result> results;
+};
+
+void bench_depend(runner& r)
+{
+    size_t n = r.quick() ? 10000 : 100000;
+    struct depend_fixture: fixture
+    {
+        std::vector<void*> resources;
+    };
+    r.run("depend", {}, 5, n, 1,
+        [&](){
+            std::unique_ptr<depend_fixture> f(new depend_fixture);
+            f->resources = f->handles(2 * n);
+            return f;
+        },
+        [](depend_fixture& f, size_t i){
+            f.gc.depend(f.resources[2 * i], f.resources[2 * i + 1]);
+        }
+    );
+
+    struct id_fixture: fixture
+    {
+        std::vector<vkgc::resource_id> ids;
+    };
+    r.run("depend_id", {}, 5, n, 1,
+        [&](){
+            std::unique_ptr<id_fixture> f(new id_fixture);
+            for(void* res: f->handles(2 * n))
+                f->ids.push_back(f->gc.register_resource(res));
+            return f;
+        },
+        [](id_fixture& f, size_t i){
+            f.gc.depend(f.ids[2 * i], f.ids[2 * i + 1]);
+        }
+    );
+}
+
+void bench_depend_many(runner& r)
+{
+    for(size_t entries: {1, 16, 1024, 65536})
+    {
+        size_t total = r.quick() ? 100000 : 1000000;
+        size_t n = std::max(size_t(4), total / entries);
+        // Like descriptor sets sharing a pile of textures: the used resources
+        // are shared, but each call has a fresh user.
+        struct many_fixture: fixture
+        {
+            std::vector<void*> used;
+            std::vector<void*> users;
+        };
+        r.run("depend_many", {{"entries", entries}}, 5, n, entries,
+            [&](){
+                std::unique_ptr<many_fixture> f(new many_fixture);
+                f->used = f->handles(entries);
+                f->users = f->handles(n);
+                return f;
+            },
+            [&](many_fixture& f, size_t i){
+                f.gc.depend_many(f.used.data(), entries, f.users[i]);
+            }
+        );
+
+        struct many_id_fixture: fixture
+        {
+            std::vector<vkgc::resource_id> used;
+            std::vector<vkgc::resource_id> users;
+        };
+        r.run("depend_many_id", {{"entries", entries}}, 5, n, entries,
+            [&](){
+                std::unique_ptr<many_id_fixture> f(new many_id_fixture);
+                for(void* res: f->handles(entries))
+                    f->used.push_back(f->gc.register_resource(res));
+                for(void* res: f->handles(n))
+                    f->users.push_back(f->gc.register_resource(res));
+                return f;
+            },
+            [&](many_id_fixture& f, size_t i){
+                f.gc.depend_many(f.used.data(), entries, f.users[i]);
+            }
+        );
+    }
+}
+
+// A submit with 64 resources that all wait for the same value, registered
+// one by one or as a group. Each iteration is one submit, depended on and
+// collected.
+void bench_submit_group(runner& r)
+{
+    const size_t per_submit = 64;
+    size_t n = r.quick() ? 2000 : 20000;
+    struct submit_fixture: fixture
+    {
+        VkSemaphore sem;
+        std::vector<void*> resources;
+    };
+    for(size_t grouped = 0; grouped < 2; ++grouped)
+    {
+        r.run("submit_group", {{"grouped", grouped}}, 5, n, per_submit,
+            [&](){
+                std::unique_ptr<submit_fixture> f(new submit_fixture);
+                f->sem = f->dev.create_timeline();
+                f->resources = f->handles(per_submit);
+                return f;
+            },
+            [&](submit_fixture& f, size_t i){
+                if(grouped)
+                    f.gc.depend_many(f.resources.data(), per_submit, f.sem, i + 1);
+                else for(void* res: f.resources)
+                    f.gc.depend(res, f.sem, i + 1);
+                f.dev.signal(f.sem, i + 1);
+                f.gc.collect();
+            }
+        );
+    }
+}
+
+void bench_release(runner& r)
+{
+    size_t n = r.quick() ? 10000 : 100000;
+    struct release_fixture: fixture
+    {
+        std::vector<void*> resources;
+    };
+
+    // Nothing uses these, so cleanup runs right away. Each one uses a shared
+    // resource, which isn't released.
+    r.run("release", {{"pending", 0}}, 5, n, 1,
+        [&](){
+            std::unique_ptr<release_fixture> f(new release_fixture);
+            void* shared = f->handle();
+            f->resources = f->handles(n);
+            for(void* res: f->resources)
+                f->gc.depend(shared, res);
+            return f;
+        },
+        [](release_fixture& f, size_t i){
+            f.gc.release(f.resources[i], [](){});
+        }
+    );
+
+    // These still wait for a timeline, so they're only marked released.
+    r.run("release", {{"pending", 1}}, 5, n, 1,
+        [&](){
+            std::unique_ptr<release_fixture> f(new release_fixture);
+            VkSemaphore sem = f->dev.create_timeline();
+            f->resources = f->handles(n);
+            for(void* res: f->resources)
+                f->gc.depend(res, sem, 1);
+            return f;
+        },
+        [](release_fixture& f, size_t i){
+            f.gc.release(f.resources[i], [](){});
+        }
+    );
+}
+
+void bench_add_trigger(runner& r)
+{
+    size_t n = r.quick() ? 10000 : 100000;
+    struct trigger_fixture: fixture
+    {
+        VkSemaphore sem;
+    };
+    r.run("add_trigger", {}, 5, n, 1,
+        [&](){
+            std::unique_ptr<trigger_fixture> f(new trigger_fixture);
+            f->sem = f->dev.create_timeline();
+            return f;
+        },
+        [](trigger_fixture& f, size_t i){
+            f.gc.add_trigger(f.sem, i + 1, [](){});
+        }
+    );
+}
+
+void bench_collect_idle(runner& r)
+{
+    size_t n = r.quick() ? 100 : 1000;
+    for(size_t semaphores: {1, 64, 1024, 16384})
+    {
+        r.run("collect_idle", {{"semaphores", semaphores}}, 3, n, semaphores,
+            [&](){
+                std::unique_ptr<fixture> f(new fixture);
+                for(size_t i = 0; i < semaphores; ++i)
+                    f->gc.depend(f->handle(), f->dev.create_timeline(), 1);
+                return f;
+            },
+            [](fixture& f, size_t){ f.gc.collect(); }
+        );
+    }
+}
+
+void bench_collect_triggers(runner& r)
+{
+    for(size_t triggers: {1, 64, 4096, 65536})
+    {
+        r.run("collect_triggers", {{"triggers", triggers}}, r.quick() ? 3 : 20, 1, triggers,
+            [&](){
+                std::unique_ptr<fixture> f(new fixture);
+                VkSemaphore sem = f->dev.create_timeline();
+                for(size_t i = 0; i < triggers; ++i)
+                {
+                    void* res = f->handle();
+                    f->gc.depend(res, sem, i + 1);
+                    f->gc.release(res, [](){});
+                }
+                f->dev.signal(sem, triggers);
+                return f;
+            },
+            [](fixture& f, size_t){ f.gc.collect(); }
+        );
+    }
+}
+
+// Builds a tree where each node uses 'fanout' nodes of the next level. The
+// root waits for a timeline, so the whole tree is destroyed by one collect().
+size_t build_tree(fixture& f, void* user, unsigned depth, unsigned fanout)
+{
+    if(depth == 0) return 0;
+    size_t count = 0;
+    for(unsigned i = 0; i < fanout; ++i)
+    {
+        void* res = f.handle();
+        f.gc.depend(res, user);
+        count += 1 + build_tree(f, res, depth - 1, fanout);
+        f.gc.release(res, [](){});
+    }
+    return count;
+}
+
+void bench_cascade(runner& r)
+{
+    struct shape
+    {
+        unsigned depth;
+        unsigned fanout;
+    };
+    std::vector<shape> shapes = {{1, 4096}, {4, 8}, {16, 2}, {4096, 1}};
+    if(!r.quick())
+        shapes.push_back({1, 262144});
+
+    for(shape s: shapes)
+    {
+        size_t nodes = 0;
+        for(size_t level = 1, width = s.fanout; level <= s.depth; ++level, width *= s.fanout)
+            nodes += width;
+        r.run("cascade", {{"depth", s.depth}, {"fanout", s.fanout}}, r.quick() ? 3 : 10, 1, nodes,
+            [&](){
+                std::unique_ptr<fixture> f(new fixture);
+                VkSemaphore sem = f->dev.create_timeline();
+                void* root = f->handle();
+                f->gc.depend(root, sem, 1);
+                build_tree(*f, root, s.depth, s.fanout);
+                f->gc.release(root, [](){});
+                f->dev.signal(sem, 1);
+                return f;
+            },
+            [](fixture& f, size_t){ f.gc.collect(); }
+        );
+    }
+
+    // Users spread over a large set of shared resources, so that most edges
+    // count down a resource that is still used by someone else.
+    size_t shared = r.quick() ? 16384 : 262144;
+    const size_t users_per_resource = 4;
+    const size_t uses = 16;
+    size_t users = shared * users_per_resource / uses;
+    r.run("cascade_shared", {{"resources", shared}, {"uses", uses}}, r.quick() ? 3 : 10, 1, shared + users,
+        [&](){
+            std::unique_ptr<fixture> f(new fixture);
+            VkSemaphore sem = f->dev.create_timeline();
+            std::vector<void*> resources = f->handles(shared);
+            std::vector<void*> used;
+            for(size_t i = 0; i < users_per_resource; ++i)
+                used.insert(used.end(), resources.begin(), resources.end());
+            std::shuffle(used.begin(), used.end(), std::mt19937(1));
+            for(size_t i = 0; i < users; ++i)
+            {
+                void* user = f->handle();
+                f->gc.depend_many(&used[i * uses], uses, user);
+                f->gc.depend(user, sem, 1);
+                f->gc.release(user, [](){});
+            }
+            for(void* res: resources)
+                f->gc.release(res, [](){});
+            f->dev.signal(sem, 1);
+            return f;
+        },
+        [](fixture& f, size_t){ f.gc.collect(); }
+    );
+}
+
+void bench_wait_collect(runner& r)
+{
+    size_t nodes = r.quick() ? 100000 : 1000000;
+    const size_t group = 64;
+    const size_t queues = 4;
+    auto setup = [&](){
+        // Command buffers on a few queues, each using a bunch of resources,
+        // like at the end of a program.
+        std::unique_ptr<fixture> f(new fixture);
+        std::vector<VkSemaphore> sems;
+        for(size_t i = 0; i < queues; ++i)
+            sems.push_back(f->dev.create_timeline());
+
+        std::vector<void*> used(group - 1);
+        for(size_t i = 0; i < nodes / group; ++i)
+        {
+            void* cmd = f->handle();
+            for(void*& res: used)
+                res = f->handle();
+            f->gc.depend_many(used.data(), used.size(), cmd);
+            VkSemaphore sem = sems[i % queues];
+            f->gc.depend(cmd, sem, i / queues + 1);
+            f->dev.submit(sem, i / queues + 1);
+            f->gc.release(cmd, [](){});
+            for(void* res: used)
+                f->gc.release(res, [](){});
+        }
+        for(VkSemaphore sem: sems)
+            f->gc.release(sem);
+        return f;
+    };
+    r.run("wait_collect_teardown", {{"nodes", nodes}}, r.quick() ? 1 : 3, 1, nodes,
+        setup, [](fixture& f, size_t){ f.gc.wait_collect(); }
+    );
+    // Same graph, but the GPU is known to be idle.
+    r.run("teardown", {{"nodes", nodes}}, r.quick() ? 1 : 3, 1, nodes,
+        setup, [](fixture& f, size_t){ f.gc.teardown(); }
+    );
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    options opt;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!std::strcmp(argv[i], "--quick"))
+            opt.quick = true;
+        else if(!std::strcmp(argv[i], "--filter") && i + 1 < argc)
+            opt.filter = argv[++i];
+        else if(!std::strcmp(argv[i], "--out") && i + 1 < argc)
+            opt.out = argv[++i];
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--quick] [--filter <substring>] [--out <file.json>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    runner r(opt);
+    bench_depend(r);
+    bench_depend_many(r);
+    bench_submit_group(r);
+    bench_release(r);
+    bench_add_trigger(r);
+    bench_collect_idle(r);
+    bench_collect_triggers(r);
+    bench_cascade(r);
+    bench_wait_collect(r);
+
+    std::FILE* f = opt.out ? std::fopen(opt.out, "w") : stdout;
+    if(!f)
+    {
+        std::fprintf(stderr, "Failed to open %s\n", opt.out);
+        return 1;
+    }
+    r.write_json(f);
+    if(f != stdout)
+        std::fclose(f);
+    return 0;
+}
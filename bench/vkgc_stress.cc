@@ -0,0 +1,362 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+// Contention benchmark: worker threads record command buffers with depend() and
+// release() while one thread runs collect(), sweeping thread counts and
+// operation mixes. Reports throughput, per-call latency percentiles and the
+// time spent waiting for the GC mutex as JSON.
+//
+// Build everything with VKGC_STATS=1, otherwise the mutex wait times are
+// missing from the report.
+//
+// Usage: vkgc_stress [--quick] [--threads <max>] [--out <file.json>]
+#include "vkgc_fake.hh"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+uint64_t elapsed_ns(clock_type::time_point start, clock_type::time_point end)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+// Log-linear latency histogram: 32 linear sub-buckets for every power of two,
+// so percentiles are accurate to ~3% with a fixed amount of memory.
+class histogram
+{
+public:
+    histogram(): buckets(64 * sub_buckets, 0), count(0) {}
+
+    void add(uint64_t ns)
+    {
+        buckets[index(ns)]++;
+        count++;
+    }
+
+    void merge(const histogram& other)
+    {
+        for(size_t i = 0; i < buckets.size(); ++i)
+            buckets[i] += other.buckets[i];
+        count += other.count;
+    }
+
+    uint64_t total() const { return count; }
+
+    uint64_t percentile(double p) const
+    {
+        uint64_t target = uint64_t(p * count);
+        uint64_t seen = 0;
+        for(size_t i = 0; i < buckets.size(); ++i)
+        {
+            seen += buckets[i];
+            if(seen > target)
+                return value(i);
+        }
+        return 0;
+    }
+
+private:
+    static const unsigned sub_bits = 5;
+    static const size_t sub_buckets = size_t(1) << sub_bits;
+
+    static size_t index(uint64_t ns)
+    {
+        if(ns < sub_buckets)
+            return ns;
+        unsigned msb = 63 - __builtin_clzll(ns);
+        unsigned shift = msb - sub_bits;
+        return (shift + 1) * sub_buckets + ((ns >> shift) & (sub_buckets - 1));
+    }
+
+    static uint64_t value(size_t index)
+    {
+        if(index < sub_buckets)
+            return index;
+        unsigned shift = index / sub_buckets - 1;
+        return (sub_buckets + index % sub_buckets) << shift;
+    }
+
+    std::vector<uint64_t> buckets;
+    uint64_t count;
+};
+
+enum op_type
+{
+    OP_DEPEND = 0,
+    OP_DEPEND_MANY,
+    OP_DEPEND_TIMELINE,
+    OP_RELEASE,
+    OP_COLLECT,
+    OP_COUNT
+};
+
+const char* op_names[OP_COUNT] = {
+    "depend", "depend_many", "depend_timeline", "release", "collect"
+};
+
+// How each worker records one "command buffer".
+struct mix
+{
+    const char* name;
+    // Resources used by each command buffer.
+    unsigned resources;
+    // Whether those are added with one depend_many() instead of depend().
+    bool batched;
+};
+
+struct thread_result
+{
+    histogram latency[OP_COUNT];
+    uint64_t ops = 0;
+};
+
+struct config_result
+{
+    unsigned threads;
+    const char* mix;
+    double seconds;
+    thread_result total;
+    uint64_t collects;
+#if VKGC_STATS
+    vkgc::garbage_collector::statistics stats;
+#endif
+};
+
+template<typename F>
+void timed(thread_result& res, op_type op, F&& f)
+{
+    auto start = clock_type::now();
+    f();
+    res.latency[op].add(elapsed_ns(start, clock_type::now()));
+    res.ops++;
+}
+
+void worker(
+    vkgc::garbage_collector& gc,
+    vkgc::fake_device& dev,
+    VkSemaphore sem,
+    unsigned index,
+    const mix& m,
+    std::atomic<bool>& stop,
+    thread_result& res
+){
+    // Handles are unique per thread and per iteration.
+    uintptr_t counter = 0;
+    auto handle = [&](){
+        counter++;
+        return (void*)((counter * 64 + index + 1) * 16);
+    };
+
+    std::vector<void*> used(m.resources);
+    uint64_t value = 0;
+    while(!stop.load(std::memory_order_relaxed))
+    {
+        void* cmd = handle();
+        for(void*& res: used)
+            res = handle();
+
+        if(m.batched)
+            timed(res, OP_DEPEND_MANY, [&](){ gc.depend_many(used.data(), used.size(), cmd); });
+        else for(void* r: used)
+            timed(res, OP_DEPEND, [&](){ gc.depend(r, cmd); });
+
+        value++;
+        timed(res, OP_DEPEND_TIMELINE, [&](){ gc.depend(cmd, sem, value); });
+        dev.submit(sem, value);
+
+        timed(res, OP_RELEASE, [&](){ gc.release(cmd, [](){}); });
+        for(void* r: used)
+            timed(res, OP_RELEASE, [&](){ gc.release(r, [](){}); });
+    }
+}
+
+config_result run_config(unsigned threads, const mix& m, std::chrono::milliseconds duration)
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+
+    std::vector<VkSemaphore> sems(threads);
+    for(VkSemaphore& sem: sems)
+        sem = dev.create_timeline();
+
+    std::atomic<bool> stop(false);
+    std::vector<thread_result> results(threads + 1);
+    std::vector<std::thread> workers;
+
+    auto start = clock_type::now();
+    for(unsigned i = 0; i < threads; ++i)
+    {
+        workers.emplace_back(
+            worker, std::ref(gc), std::ref(dev), sems[i], i, std::cref(m),
+            std::ref(stop), std::ref(results[i])
+        );
+    }
+
+    // The collector thread plays the role of the GPU too: it finishes all
+    // submitted work before each collect().
+    uint64_t collects = 0;
+    thread_result& collector = results[threads];
+    while(clock_type::now() - start < duration)
+    {
+        dev.finish();
+        timed(collector, OP_COLLECT, [&](){ gc.collect(); });
+        collects++;
+    }
+    stop = true;
+    for(std::thread& t: workers)
+        t.join();
+    double seconds = elapsed_ns(start, clock_type::now()) * 1e-9;
+
+    config_result res;
+    res.threads = threads;
+    res.mix = m.name;
+    res.seconds = seconds;
+    res.collects = collects;
+#if VKGC_STATS
+    res.stats = gc.get_statistics();
+#endif
+    for(const thread_result& r: results)
+    {
+        for(unsigned op = 0; op < OP_COUNT; ++op)
+            res.total.latency[op].merge(r.latency[op]);
+        res.total.ops += r.ops;
+    }
+
+    for(VkSemaphore sem: sems)
+        gc.release(sem);
+    gc.wait_collect();
+    return res;
+}
+
+void write_json(std::FILE* f, const std::vector<config_result>& results)
+{
+    std::fprintf(f, "{\n  \"stats\": %s,\n  \"results\": [\n", VKGC_STATS ? "true" : "false");
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const config_result& res = results[i];
+        std::fprintf(
+            f, "    {\"threads\": %u, \"mix\": \"%s\", \"seconds\": %.6f, "
+            "\"ops\": %llu, \"ops_per_sec\": %.1f, \"collects\": %llu, \"latency_ns\": {",
+            res.threads, res.mix, res.seconds, (unsigned long long)res.total.ops,
+            res.total.ops / res.seconds, (unsigned long long)res.collects
+        );
+        bool first = true;
+        for(unsigned op = 0; op < OP_COUNT; ++op)
+        {
+            const histogram& h = res.total.latency[op];
+            if(h.total() == 0)
+                continue;
+            std::fprintf(
+                f, "%s\"%s\": {\"count\": %llu, \"p50\": %llu, \"p99\": %llu, \"p999\": %llu}",
+                first ? "" : ", ", op_names[op], (unsigned long long)h.total(),
+                (unsigned long long)h.percentile(0.5),
+                (unsigned long long)h.percentile(0.99),
+                (unsigned long long)h.percentile(0.999)
+            );
+            first = false;
+        }
+        std::fprintf(f, "}");
+#if VKGC_STATS
+        std::fprintf(
+            f, ", \"lock\": {\"acquisitions\": %llu, \"contentions\": %llu, "
+            "\"wait_ns\": %llu, \"wait_fraction\": %.4f}",
+            (unsigned long long)res.stats.lock_acquisitions,
+            (unsigned long long)res.stats.lock_contentions,
+            (unsigned long long)res.stats.lock_wait_ns,
+            // Fraction of the threads' combined time spent waiting.
+            res.stats.lock_wait_ns * 1e-9 / (res.seconds * (res.threads + 1))
+        );
+#endif
+        std::fprintf(f, "}%s\n", i + 1 == results.size() ? "" : ",");
+    }
+    std::fprintf(f, "  ]\n}\n");
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    bool quick = false;
+    unsigned max_threads = 32;
+    const char* out = nullptr;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!std::strcmp(argv[i], "--quick"))
+            quick = true;
+        else if(!std::strcmp(argv[i], "--threads") && i + 1 < argc)
+            max_threads = std::max(1, std::atoi(argv[++i]));
+        else if(!std::strcmp(argv[i], "--out") && i + 1 < argc)
+            out = argv[++i];
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--quick] [--threads <max>] [--out <file.json>]\n", argv[0]);
+            return 1;
+        }
+    }
+#if !VKGC_STATS
+    std::fprintf(stderr, "Built without VKGC_STATS, mutex wait times are not reported.\n");
+#endif
+
+    const mix mixes[] = {
+        {"single", 1, false},
+        {"wide", 16, false},
+        {"batched", 16, true}
+    };
+    std::chrono::milliseconds duration(quick ? 100 : 1000);
+
+    std::vector<config_result> results;
+    for(const mix& m: mixes)
+    for(unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        results.push_back(run_config(threads, m, duration));
+        const config_result& res = results.back();
+        std::fprintf(
+            stderr, "%-8s %2u threads: %12.0f ops/s\n",
+            m.name, threads, res.total.ops / res.seconds
+        );
+    }
+
+    std::FILE* f = out ? std::fopen(out, "w") : stdout;
+    if(!f)
+    {
+        std::fprintf(stderr, "Failed to open %s\n", out);
+        return 1;
+    }
+    write_json(f, results);
+    if(f != stdout)
+        std::fclose(f);
+    return 0;
+}
@@ -0,0 +1,769 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+// Differential fuzzer: decodes random sequences of depend, depend_many,
+// timeline depend, grouped timeline depend, add_trigger, release, recyclable
+// release, acquire, semaphore signal, collect, semaphore release, submit,
+// finish and wait_collect calls, runs them against both the GC on the fake
+// device and a deliberately naive lifetime model, and aborts if the two
+// disagree on what is destroyed, fired or acquired after any call, or if the
+// GC destroys a resource before one of its users.
+//
+// Build with -fsanitize=fuzzer and VKGC_LIBFUZZER for libFuzzer. Otherwise,
+// this is a standalone program that runs the given input files, or random
+// inputs:
+//
+//     vkgc_fuzz [--iterations <n>] [--seed <n>] [files...]
+#include "vkgc_fake.hh"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const unsigned resource_count = 12;
+const unsigned semaphore_count = 3;
+// The model's index of the GC's internal timeline of the queue.
+const unsigned queue_timeline = semaphore_count;
+
+// Hands out input bytes, and zeroes once they run out.
+class byte_reader
+{
+public:
+    byte_reader(const uint8_t* data, size_t size): data(data), end(data + size) {}
+
+    bool empty() const { return data == end; }
+    unsigned next() { return data == end ? 0 : *data++; }
+    unsigned next(unsigned range) { return next() % range; }
+
+private:
+    const uint8_t* data;
+    const uint8_t* end;
+};
+
+// The reference model. It keeps every edge explicitly and after each call
+// simply destroys everything that has become destroyable until nothing
+// changes.
+struct model
+{
+    struct resource
+    {
+        bool released = false;
+        // From release_recyclable(), 0 is released for good.
+        uint64_t key = 0;
+        // In the recycling pool, still using what it used before.
+        bool pooled = false;
+        // The call that pooled it, see acquire().
+        unsigned pooled_at = 0;
+        // Resources this one uses, once per edge.
+        std::vector<unsigned> uses;
+        // Timeline waits that collect() hasn't seen pass yet.
+        std::vector<std::pair<unsigned /*semaphore*/, uint64_t>> waits;
+    };
+
+    struct trigger
+    {
+        unsigned semaphore;
+        uint64_t value;
+        unsigned id;
+    };
+
+    struct semaphore
+    {
+        bool released = false;
+        uint64_t value = 0;
+        // Only the queue timeline has submitted work.
+        uint64_t submitted = 0;
+        // Once the GC knows the semaphore, collect() caches its value, and
+        // waits for values up to that are skipped.
+        bool tracked = false;
+        uint64_t observed = 0;
+    };
+
+    resource resources[resource_count];
+    semaphore semaphores[semaphore_count + 1];
+    std::vector<trigger> triggers;
+    // Whether the GC has a timeline for the queue.
+    bool queue_open = false;
+    // Counts calls, so that acquire() knows which resources were pooled
+    // together.
+    unsigned calls = 0;
+
+    bool reached(unsigned s, uint64_t value) const
+    {
+        return semaphores[s].tracked && semaphores[s].observed >= value;
+    }
+
+    unsigned users(unsigned index) const
+    {
+        unsigned count = 0;
+        for(const resource& r: resources)
+            count += std::count(r.uses.begin(), r.uses.end(), index);
+        return count;
+    }
+
+    // Ready recyclable resources are pooled instead, unless 'pooling' is
+    // false, which destroys the pooled ones too.
+    void destroy_ready(std::vector<unsigned>& destroyed, bool pooling = true)
+    {
+        bool changed = true;
+        while(changed)
+        {
+            changed = false;
+            for(unsigned i = 0; i < resource_count; ++i)
+            {
+                resource& r = resources[i];
+                if(!r.released || !r.waits.empty() || users(i) != 0)
+                    continue;
+                if(pooling && r.pooled)
+                    continue;
+                if(pooling && r.key != 0)
+                {
+                    r.pooled = true;
+                    r.pooled_at = calls;
+                    continue;
+                }
+                destroyed.push_back(i);
+                r = resource();
+                changed = true;
+            }
+        }
+    }
+
+    // The GC hands out the most recently pooled resource with the key, but
+    // the order in which one call pools resources is up to it. Returns
+    // whether 'index' is one of those candidates, or, for resource_count,
+    // whether there are none.
+    bool can_acquire(uint64_t key, unsigned index) const
+    {
+        bool any = false;
+        unsigned newest = 0;
+        for(const resource& r: resources)
+        {
+            if(key != 0 && r.pooled && r.key == key && (!any || r.pooled_at > newest))
+                newest = r.pooled_at;
+            any |= key != 0 && r.pooled && r.key == key;
+        }
+        if(index == resource_count)
+            return !any;
+        const resource& r = resources[index];
+        return any && r.pooled && r.key == key && r.pooled_at == newest;
+    }
+
+    void evict_all(std::vector<unsigned>& destroyed)
+    {
+        // Evicting may make more recyclable resources ready.
+        bool pooled = true;
+        while(pooled)
+        {
+            pooled = false;
+            for(unsigned i = 0; i < resource_count; ++i)
+            {
+                if(resources[i].pooled)
+                {
+                    destroyed.push_back(i);
+                    resources[i] = resource();
+                    pooled = true;
+                }
+            }
+            destroy_ready(destroyed);
+        }
+    }
+
+    void collect(
+        std::vector<unsigned>& destroyed,
+        std::vector<unsigned>& fired,
+        std::vector<unsigned>& destroyed_semaphores
+    ){
+        for(semaphore& s: semaphores)
+            if(s.tracked)
+                s.observed = s.value;
+        for(resource& r: resources)
+        {
+            r.waits.erase(std::remove_if(r.waits.begin(), r.waits.end(),
+                [&](const std::pair<unsigned, uint64_t>& w){
+                    return semaphores[w.first].value >= w.second;
+                }), r.waits.end());
+        }
+        for(auto it = triggers.begin(); it != triggers.end();)
+        {
+            if(semaphores[it->semaphore].value >= it->value)
+            {
+                fired.push_back(it->id);
+                it = triggers.erase(it);
+            }
+            else ++it;
+        }
+        destroy_ready(destroyed);
+
+        for(unsigned s = 0; s <= queue_timeline; ++s)
+        {
+            if(!semaphores[s].released)
+                continue;
+            bool pending = false;
+            for(const resource& r: resources)
+            for(const auto& w: r.waits)
+                pending |= w.first == s;
+            for(const trigger& t: triggers)
+                pending |= t.semaphore == s;
+            if(!pending)
+                destroy_semaphore(s, destroyed_semaphores);
+        }
+    }
+
+    void destroy_semaphore(unsigned s, std::vector<unsigned>& destroyed_semaphores)
+    {
+        destroyed_semaphores.push_back(s);
+        semaphores[s] = semaphore();
+        if(s == queue_timeline)
+            queue_open = false;
+    }
+
+    // wait_collect() and teardown() release the queue timeline, and the
+    // next submit starts a new one.
+    void release_queue()
+    {
+        if(!queue_open)
+            return;
+        semaphores[queue_timeline].released = true;
+        semaphores[queue_timeline].tracked = true;
+    }
+
+    // Only the queue's work is ever waited for, the other semaphores are
+    // signaled by the host.
+    void wait_collect(
+        std::vector<unsigned>& destroyed,
+        std::vector<unsigned>& fired,
+        std::vector<unsigned>& destroyed_semaphores
+    ){
+        collect(destroyed, fired, destroyed_semaphores);
+        release_queue();
+        semaphore& q = semaphores[queue_timeline];
+        q.value = q.submitted;
+        collect(destroyed, fired, destroyed_semaphores);
+        evict_all(destroyed);
+    }
+
+    // Every wait counts as done, and released semaphores go regardless of
+    // their value.
+    void teardown(
+        std::vector<unsigned>& destroyed,
+        std::vector<unsigned>& fired,
+        std::vector<unsigned>& destroyed_semaphores
+    ){
+        release_queue();
+        for(resource& r: resources)
+            r.waits.clear();
+        for(const trigger& t: triggers)
+            fired.push_back(t.id);
+        triggers.clear();
+        destroy_ready(destroyed, false);
+
+        for(unsigned s = 0; s <= queue_timeline; ++s)
+            if(semaphores[s].released)
+                destroy_semaphore(s, destroyed_semaphores);
+    }
+};
+
+class harness
+{
+public:
+    harness()
+    : gc(dev.device(), dev.dispatch()), queue(dev.queue()), trigger_counter(0)
+    {
+        gc.set_leak_handler([](const vkgc::garbage_collector::leak_report&){});
+        // Pooled resources are only evicted by wait_collect(), so that runs
+        // don't depend on timing.
+        gc.set_recycling_limits(std::chrono::hours(1), SIZE_MAX);
+        for(VkSemaphore& sem: semaphores)
+            sem = dev.create_timeline();
+    }
+
+    void run(byte_reader& in)
+    {
+        while(!in.empty())
+        {
+            switch(in.next(15))
+            {
+            case 0: depend(in.next(resource_count), in.next(resource_count)); break;
+            case 1: depend_many(in); break;
+            case 2: depend_timeline(in.next(resource_count), in.next(semaphore_count), in.next(4)); break;
+            case 3: add_trigger(in.next(semaphore_count), in.next(4)); break;
+            case 4: release(in.next(resource_count)); break;
+            case 5: signal(in.next(semaphore_count), 1 + in.next(4)); break;
+            case 6: collect(); break;
+            case 7: release_semaphore(in.next(semaphore_count)); break;
+            case 8: depend_many_timeline(in); break;
+            case 9: if(in.next(4) == 0) teardown(); break;
+            case 10: release_recyclable(in.next(resource_count), in.next(3)); break;
+            case 11: acquire(in.next(3)); break;
+            case 12: submit(in); break;
+            case 13: finish(); break;
+            case 14: wait_collect(); break;
+            }
+        }
+
+        // In the end, everything must go away once it's released and the
+        // semaphores have passed every value.
+        for(unsigned i = 0; i < resource_count; ++i)
+            release(i);
+        for(unsigned s = 0; s < semaphore_count; ++s)
+        {
+            signal(s, 4 * max_delta_total);
+            release_semaphore(s);
+        }
+        collect();
+        wait_collect();
+        if(!gc.report(std::chrono::steady_clock::duration::zero()).empty())
+            fail("resources or semaphores left after releasing everything");
+    }
+
+private:
+    static const uint64_t max_delta_total = 1 << 20;
+
+    static void* handle(unsigned index)
+    {
+        return (void*)(uintptr_t)((index + 1) * 16);
+    }
+
+    std::function<void()> cleanup(unsigned index)
+    {
+        return [this, index](){ gc_destroyed.push_back(index); };
+    }
+
+    // Dependencies must not be added to released resources, and they must go
+    // from higher to lower indices so that no cycles form.
+    void depend(unsigned a, unsigned b)
+    {
+        unsigned used = std::min(a, b), user = std::max(a, b);
+        if(used == user || m.resources[used].released || m.resources[user].released)
+            return;
+        log("depend(" + std::to_string(used) + ", " + std::to_string(user) + ")");
+        m.resources[user].uses.push_back(used);
+        // Half of the calls go through resource ids.
+        if((used ^ user) & 1)
+            gc.depend(gc.register_resource(handle(used)), gc.register_resource(handle(user)));
+        else gc.depend(handle(used), handle(user));
+        check();
+    }
+
+    void depend_many(byte_reader& in)
+    {
+        unsigned user = in.next(resource_count);
+        unsigned count = 1 + in.next(4);
+        std::vector<void*> used;
+        std::string desc = "depend_many({";
+        for(unsigned i = 0; i < count; ++i)
+        {
+            unsigned index = in.next(resource_count);
+            if(index >= user || m.resources[index].released)
+                continue;
+            used.push_back(handle(index));
+            m.resources[user].uses.push_back(index);
+            desc += std::to_string(index) + " ";
+        }
+        if(m.resources[user].released || used.empty())
+        {
+            m.resources[user].uses.resize(m.resources[user].uses.size() - used.size());
+            return;
+        }
+        log(desc + "}, " + std::to_string(user) + ")");
+        gc.depend_many(used.data(), used.size(), handle(user));
+        check();
+    }
+
+    void depend_timeline(unsigned index, unsigned s, unsigned delta)
+    {
+        if(m.resources[index].released || m.semaphores[s].released)
+            return;
+        // A delta of zero waits for a value that has already been reached.
+        uint64_t value = m.semaphores[s].value + delta;
+        log("depend(" + std::to_string(index) + ", sem" + std::to_string(s) + ", " + std::to_string(value) + ")");
+        if(!m.reached(s, value))
+            m.resources[index].waits.push_back({s, value});
+        m.semaphores[s].tracked = true;
+        gc.depend(handle(index), semaphores[s], value);
+        check();
+    }
+
+    void depend_many_timeline(byte_reader& in)
+    {
+        unsigned s = in.next(semaphore_count);
+        uint64_t value = m.semaphores[s].value + in.next(4);
+        unsigned count = 1 + in.next(8);
+        std::vector<void*> used;
+        std::string desc = "depend_many({";
+        for(unsigned i = 0; i < count; ++i)
+        {
+            // The same resource may show up more than once.
+            unsigned index = in.next(resource_count);
+            if(m.resources[index].released)
+                continue;
+            used.push_back(handle(index));
+            desc += std::to_string(index) + " ";
+        }
+        if(m.semaphores[s].released)
+            return;
+        if(!used.empty() && !m.reached(s, value))
+        {
+            for(void* res: used)
+                m.resources[(uintptr_t)res / 16 - 1].waits.push_back({s, value});
+            m.semaphores[s].tracked = true;
+        }
+        log(desc + "}, sem" + std::to_string(s) + ", " + std::to_string(value) + ")");
+        if(s & 1)
+        {
+            std::vector<vkgc::resource_id> ids;
+            for(void* res: used)
+                ids.push_back(gc.register_resource(res));
+            gc.depend_many(ids.data(), ids.size(), semaphores[s], value);
+        }
+        else gc.depend_many(used.data(), used.size(), semaphores[s], value);
+        check();
+    }
+
+    void add_trigger(unsigned s, unsigned delta)
+    {
+        if(m.semaphores[s].released)
+            return;
+        uint64_t value = m.semaphores[s].value + delta;
+        unsigned id = trigger_counter++;
+        log("add_trigger(sem" + std::to_string(s) + ", " + std::to_string(value) + ") #" + std::to_string(id));
+        m.triggers.push_back({s, value, id});
+        m.semaphores[s].tracked = true;
+        gc.add_trigger(semaphores[s], value, [this, id](){ gc_fired.push_back(id); });
+        check();
+    }
+
+    void release(unsigned index)
+    {
+        if(m.resources[index].released)
+            return;
+        log("release(" + std::to_string(index) + ")");
+        // Also releases an acquired resource for good.
+        m.resources[index].released = true;
+        m.resources[index].key = 0;
+        m.destroy_ready(expected_destroyed);
+        if(index & 1)
+            gc.release(gc.register_resource(handle(index)), cleanup(index));
+        else gc.release(handle(index), cleanup(index));
+        check();
+    }
+
+    void release_recyclable(unsigned index, uint64_t key)
+    {
+        if(m.resources[index].released)
+            return;
+        log("release_recyclable(" + std::to_string(index) + ", " + std::to_string(key) + ")");
+        m.resources[index].released = true;
+        m.resources[index].key = key;
+        m.destroy_ready(expected_destroyed);
+        gc.release_recyclable(handle(index), key, 1, cleanup(index));
+        check();
+    }
+
+    void acquire(uint64_t key)
+    {
+        log("acquire(" + std::to_string(key) + ")");
+        void* res = gc.acquire(key);
+        unsigned index = res ? unsigned((uintptr_t)res / 16 - 1) : resource_count;
+        if(index > resource_count || !m.can_acquire(key, index))
+            fail("acquired the wrong resource");
+        if(res)
+        {
+            m.resources[index].released = false;
+            m.resources[index].pooled = false;
+        }
+        check();
+    }
+
+    // Resources stand in for command buffers, which depend on the value the
+    // submit signals on the queue timeline.
+    void submit(byte_reader& in)
+    {
+        unsigned count = in.next(3);
+        std::vector<VkCommandBufferSubmitInfo> cmds;
+        std::string desc = "submit({";
+        model::semaphore& q = m.semaphores[queue_timeline];
+        for(unsigned i = 0; i < count; ++i)
+        {
+            unsigned index = in.next(resource_count);
+            if(m.resources[index].released)
+                continue;
+            VkCommandBufferSubmitInfo cmd = {};
+            cmd.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+            cmd.commandBuffer = (VkCommandBuffer)handle(index);
+            cmds.push_back(cmd);
+            m.resources[index].waits.push_back({queue_timeline, q.submitted + 1});
+            desc += std::to_string(index) + " ";
+        }
+        q.submitted++;
+        q.tracked |= !cmds.empty();
+        m.queue_open = true;
+        log(desc + "}) = " + std::to_string(q.submitted));
+
+        VkSubmitInfo2 submit = {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submit.commandBufferInfoCount = (uint32_t)cmds.size();
+        submit.pCommandBufferInfos = cmds.data();
+        if(gc.submit(queue, 1, &submit) != VK_SUCCESS)
+            fail("submit failed");
+        timeline = gc.get_queue_timeline(queue);
+        check();
+    }
+
+    // Lets the queue run all of its submitted work.
+    void finish()
+    {
+        log("finish()");
+        model::semaphore& q = m.semaphores[queue_timeline];
+        q.value = q.submitted;
+        dev.finish();
+    }
+
+    // Waits without a timeout only if nothing waits for a host signal that
+    // hasn't happened, which would hang.
+    void wait_collect()
+    {
+        bool blocks = false;
+        for(const model::resource& r: m.resources)
+        for(const auto& w: r.waits)
+            blocks |= w.first != queue_timeline && m.semaphores[w.first].value < w.second;
+        for(const model::trigger& t: m.triggers)
+            blocks |= m.semaphores[t.semaphore].value < t.value;
+        log(blocks ? "wait_collect(0)" : "wait_collect()");
+        m.wait_collect(expected_destroyed, expected_fired, expected_destroyed_semaphores);
+        size_t log_start = dev.destroy_log().size();
+        if(blocks)
+        {
+            if(gc.wait_collect(0) != VK_TIMEOUT)
+                fail("wait_collect(0) didn't time out");
+        }
+        else gc.wait_collect();
+        check_semaphores(log_start);
+    }
+
+    void signal(unsigned s, uint64_t delta)
+    {
+        m.semaphores[s].value += delta;
+        log("signal(sem" + std::to_string(s) + ", " + std::to_string(m.semaphores[s].value) + ")");
+        dev.signal(semaphores[s], m.semaphores[s].value);
+    }
+
+    void collect()
+    {
+        log("collect()");
+        m.collect(expected_destroyed, expected_fired, expected_destroyed_semaphores);
+        size_t log_start = dev.destroy_log().size();
+        gc.collect();
+        check_semaphores(log_start);
+    }
+
+    void teardown()
+    {
+        // Like vkDeviceWaitIdle() before it.
+        finish();
+        log("teardown()");
+        m.teardown(expected_destroyed, expected_fired, expected_destroyed_semaphores);
+        size_t log_start = dev.destroy_log().size();
+        uint64_t polls = dev.call_count(vkgc::fake_device::GET_SEMAPHORE_COUNTER_VALUE) +
+            dev.call_count(vkgc::fake_device::WAIT_SEMAPHORES);
+        gc.teardown();
+        if(dev.call_count(vkgc::fake_device::GET_SEMAPHORE_COUNTER_VALUE) +
+            dev.call_count(vkgc::fake_device::WAIT_SEMAPHORES) != polls)
+            fail("teardown() polled a semaphore");
+        check_semaphores(log_start);
+    }
+
+    void check_semaphores(size_t log_start)
+    {
+        std::vector<vkgc::fake_device::call> destroys = dev.destroy_log();
+        std::vector<unsigned> destroyed_semaphores;
+        for(size_t i = log_start; i < destroys.size(); ++i)
+        {
+            VkSemaphore sem = (VkSemaphore)(uintptr_t)destroys[i].handle;
+            unsigned s = std::find(semaphores, semaphores + semaphore_count, sem) - semaphores;
+            if(s == semaphore_count && sem != timeline)
+                s = semaphore_count + 1;
+            destroyed_semaphores.push_back(s);
+        }
+        if(sorted(destroyed_semaphores) != sorted(expected_destroyed_semaphores))
+            fail("destroyed semaphores differ");
+
+        // The model restarts destroyed semaphores from zero, and so does the
+        // fake device with a new handle. The GC makes a new queue timeline
+        // on the next submit.
+        for(unsigned s: destroyed_semaphores)
+        {
+            if(s < semaphore_count)
+                semaphores[s] = dev.create_timeline();
+            else if(s == queue_timeline)
+                timeline = VK_NULL_HANDLE;
+        }
+        expected_destroyed_semaphores.clear();
+        check();
+    }
+
+    void release_semaphore(unsigned s)
+    {
+        if(m.semaphores[s].released)
+            return;
+        log("release(sem" + std::to_string(s) + ")");
+        m.semaphores[s].released = true;
+        m.semaphores[s].tracked = true;
+        gc.release(semaphores[s]);
+        check();
+    }
+
+    void check()
+    {
+        if(sorted(gc_destroyed) != sorted(expected_destroyed))
+            fail("destroyed resources differ");
+        if(sorted(gc_fired) != sorted(expected_fired))
+            fail("fired triggers differ");
+        if(dev.error_count() != 0)
+            fail("invalid semaphore handle used");
+
+        // Users must be destroyed before the resources they use. The edges of
+        // destroyed resources are gone from the model, so they're taken from
+        // the snapshot before this call.
+        for(size_t i = 0; i < gc_destroyed.size(); ++i)
+        for(size_t j = i + 1; j < gc_destroyed.size(); ++j)
+        {
+            const std::vector<unsigned>& uses = edges_before[gc_destroyed[j]];
+            if(std::count(uses.begin(), uses.end(), gc_destroyed[i]))
+                fail("resource destroyed before its user");
+        }
+
+        gc_destroyed.clear();
+        expected_destroyed.clear();
+        gc_fired.clear();
+        expected_fired.clear();
+        m.calls++;
+        for(unsigned i = 0; i < resource_count; ++i)
+            edges_before[i] = m.resources[i].uses;
+    }
+
+    void log(const std::string& call)
+    {
+        calls.push_back(call);
+    }
+
+    [[noreturn]] void fail(const char* reason)
+    {
+        std::fprintf(stderr, "vkgc_fuzz: %s after:\n", reason);
+        for(const std::string& call: calls)
+            std::fprintf(stderr, "  %s\n", call.c_str());
+        std::fprintf(stderr, "GC destroyed:");
+        for(unsigned i: gc_destroyed) std::fprintf(stderr, " %u", i);
+        std::fprintf(stderr, "\nmodel destroyed:");
+        for(unsigned i: expected_destroyed) std::fprintf(stderr, " %u", i);
+        std::fprintf(stderr, "\nGC fired:");
+        for(unsigned i: gc_fired) std::fprintf(stderr, " %u", i);
+        std::fprintf(stderr, "\nmodel fired:");
+        for(unsigned i: expected_fired) std::fprintf(stderr, " %u", i);
+        std::fprintf(stderr, "\n");
+        std::abort();
+    }
+
+    static std::vector<unsigned> sorted(std::vector<unsigned> v)
+    {
+        std::sort(v.begin(), v.end());
+        return v;
+    }
+
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc;
+    VkSemaphore semaphores[semaphore_count];
+    VkQueue queue;
+    // The GC's timeline of 'queue', once it has one.
+    VkSemaphore timeline = VK_NULL_HANDLE;
+    model m;
+    unsigned trigger_counter;
+
+    std::vector<unsigned> gc_destroyed, expected_destroyed;
+    std::vector<unsigned> gc_fired, expected_fired;
+    std::vector<unsigned> expected_destroyed_semaphores;
+    std::vector<unsigned> edges_before[resource_count];
+    std::vector<std::string> calls;
+};
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    byte_reader in(data, size);
+    harness h;
+    h.run(in);
+    return 0;
+}
+
+#ifndef VKGC_LIBFUZZER
+int main(int argc, char** argv)
+{
+    unsigned iterations = 10000;
+    unsigned seed = 1;
+    std::vector<const char*> files;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!std::strcmp(argv[i], "--iterations") && i + 1 < argc)
+            iterations = std::strtoul(argv[++i], nullptr, 10);
+        else if(!std::strcmp(argv[i], "--seed") && i + 1 < argc)
+            seed = std::strtoul(argv[++i], nullptr, 10);
+        else files.push_back(argv[i]);
+    }
+
+    for(const char* path: files)
+    {
+        std::ifstream f(path, std::ios::binary);
+        std::vector<uint8_t> data(
+            (std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>()
+        );
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+    }
+
+    if(files.empty())
+    {
+        std::mt19937 rng(seed);
+        std::vector<uint8_t> data;
+        for(unsigned i = 0; i < iterations; ++i)
+        {
+            data.resize(rng() % 1024);
+            for(uint8_t& byte: data)
+                byte = rng();
+            LLVMFuzzerTestOneInput(data.data(), data.size());
+        }
+    }
+    return 0;
+}
+#endif
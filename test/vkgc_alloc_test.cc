@@ -0,0 +1,233 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+// Checks that a representative frame loop of depend/release/collect doesn't
+// allocate once the GC has warmed up. Global operator new is replaced, and
+// every allocation in the measured frames is reported with the GC call that
+// made it and a backtrace where available.
+//
+//     vkgc_alloc_test [--warmup <frames>] [--frames <frames>]
+#include "vkgc_fake.hh"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <execinfo.h>
+#define VKGC_HAS_BACKTRACE 1
+#else
+#define VKGC_HAS_BACKTRACE 0
+#endif
+
+namespace
+{
+
+// Allocations are only recorded while 'counting' is set, into fixed storage
+// so that recording doesn't allocate itself.
+struct allocation
+{
+    const char* op;
+    size_t size;
+    unsigned frame;
+#if VKGC_HAS_BACKTRACE
+    void* stack[32];
+    int depth;
+#endif
+};
+
+const unsigned max_recorded = 16;
+allocation recorded[max_recorded];
+unsigned allocation_count = 0;
+bool counting = false;
+bool in_hook = false;
+const char* current_op = "(none)";
+unsigned current_frame = 0;
+
+void record(size_t size)
+{
+    if(!counting || in_hook)
+        return;
+    in_hook = true;
+    if(allocation_count < max_recorded)
+    {
+        allocation& a = recorded[allocation_count];
+        a.op = current_op;
+        a.size = size;
+        a.frame = current_frame;
+#if VKGC_HAS_BACKTRACE
+        a.depth = backtrace(a.stack, 32);
+#endif
+    }
+    allocation_count++;
+    in_hook = false;
+}
+
+}
+
+void* operator new(size_t size)
+{
+    record(size);
+    if(void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace
+{
+
+// Labels the GC call that follows, for the report.
+#define OP(name, call) \
+    do { current_op = name; call; current_op = "(none)"; } while(0)
+
+// A frame of a small renderer: per-frame images, views, descriptor sets and
+// command buffers, with two frames in flight. Handles keep changing like
+// they would with a real driver.
+struct frame_loop
+{
+    frame_loop(vkgc::fake_device& dev, vkgc::garbage_collector& gc)
+    : dev(dev), gc(gc), sem(dev.create_timeline()) {}
+
+    vkgc::fake_device& dev;
+    vkgc::garbage_collector& gc;
+    VkSemaphore sem;
+    uintptr_t next_handle = 1;
+    unsigned destroyed = 0;
+    unsigned fired = 0;
+
+    void* handle() { return (void*)(next_handle++ * 16); }
+
+    void run(unsigned frame)
+    {
+        current_frame = frame;
+        uint64_t value = frame + 1;
+
+        void* views[16];
+        void* sets[4];
+        for(void*& view: views)
+        {
+            void* image = handle();
+            view = handle();
+            OP("depend", gc.depend(image, view));
+            OP("release", gc.release(image, [this](){ destroyed++; }));
+        }
+        for(unsigned i = 0; i < 4; ++i)
+        {
+            sets[i] = handle();
+            OP("depend_many", gc.depend_many(views + i * 4, 4, sets[i]));
+        }
+        for(void* view: views)
+            OP("release", gc.release(view, [this](){ destroyed++; }));
+
+        void* cmd = handle();
+        OP("depend_many", gc.depend_many(sets, 4, cmd));
+        OP("depend(timeline)", gc.depend(cmd, sem, value));
+        OP("add_trigger", gc.add_trigger(sem, value, [this](){ fired++; }));
+        for(void* set: sets)
+            OP("release", gc.release(set, [this](){ destroyed++; }));
+        OP("release", gc.release(cmd, [this](){ destroyed++; }));
+
+        // Two frames in flight.
+        if(value > 2)
+            dev.signal(sem, value - 2);
+        OP("collect", gc.collect());
+    }
+};
+
+}
+
+int main(int argc, char** argv)
+{
+    unsigned warmup = 16;
+    unsigned frames = 256;
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        if(!std::strcmp(argv[i], "--warmup"))
+            warmup = std::strtoul(argv[i + 1], nullptr, 10);
+        else if(!std::strcmp(argv[i], "--frames"))
+            frames = std::strtoul(argv[i + 1], nullptr, 10);
+    }
+
+#if VKGC_HAS_BACKTRACE
+    // The first backtrace() loads the unwinder, which allocates.
+    void* dummy[1];
+    backtrace(dummy, 1);
+#endif
+
+    vkgc::fake_device dev;
+    unsigned failures = 0;
+    {
+        vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+        frame_loop loop(dev, gc);
+
+        for(unsigned frame = 0; frame < warmup; ++frame)
+            loop.run(frame);
+
+        counting = true;
+        for(unsigned frame = warmup; frame < warmup + frames; ++frame)
+            loop.run(frame);
+        counting = false;
+
+        if(loop.destroyed == 0 || loop.fired == 0)
+        {
+            std::fprintf(stderr, "vkgc_alloc_test: frame loop didn't destroy anything\n");
+            failures++;
+        }
+
+        gc.release(loop.sem);
+        dev.signal(loop.sem, warmup + frames);
+        gc.collect();
+    }
+
+    if(allocation_count != 0)
+    {
+        std::fprintf(
+            stderr, "vkgc_alloc_test: %u allocations in %u frames after warm-up\n",
+            allocation_count, frames
+        );
+        for(unsigned i = 0; i < allocation_count && i < max_recorded; ++i)
+        {
+            const allocation& a = recorded[i];
+            std::fprintf(stderr, "  %zu bytes in %s, frame %u\n", a.size, a.op, a.frame);
+#if VKGC_HAS_BACKTRACE
+            std::fflush(stderr);
+            backtrace_symbols_fd(a.stack, a.depth, 2);
+#endif
+        }
+        failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
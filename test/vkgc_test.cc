@@ -0,0 +1,1263 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+// Functional tests for the GC, running on the fake device. With
+// --keep-traces, the recording tests leave their traces in the working
+// directory for vkgc_replay.
+#include "vkgc_fake.hh"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+namespace
+{
+
+int failures = 0;
+bool keep_traces = false;
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) \
+        { \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while(0)
+
+void* res(uintptr_t i)
+{
+    return (void*)(i * 16);
+}
+
+// Collects the order in which cleanups run.
+struct destroy_order
+{
+    std::vector<void*> order;
+
+    std::function<void()> cleanup(void* resource)
+    {
+        return [this, resource](){ order.push_back(resource); };
+    }
+
+    bool before(void* a, void* b) const
+    {
+        auto ia = std::find(order.begin(), order.end(), a);
+        auto ib = std::find(order.begin(), order.end(), b);
+        return ia != order.end() && ib != order.end() && ia < ib;
+    }
+};
+
+void test_release_without_dependencies()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+    gc.release(res(1), d.cleanup(res(1)));
+    CHECK(d.order.size() == 1);
+}
+
+void test_null_handles()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    gc.set_leak_handler([](const vkgc::garbage_collector::leak_report&){});
+    destroy_order d;
+    VkSemaphore sem = dev.create_timeline();
+
+    // None of these track anything.
+    void* used[] = {res(1), nullptr};
+    gc.depend((void*)nullptr, res(2));
+    gc.depend(res(1), (void*)nullptr);
+    gc.depend_many(used, 2, res(2));
+    gc.depend((void*)nullptr, sem, 1);
+    gc.depend(res(1), VkSemaphore(VK_NULL_HANDLE), 1);
+    gc.depend(res(1), VkFence(VK_NULL_HANDLE));
+    gc.depend_many(used, 2, VkSemaphore(VK_NULL_HANDLE), 1);
+    gc.release(VkSemaphore(VK_NULL_HANDLE));
+    gc.release_fence(VK_NULL_HANDLE);
+    CHECK(!gc.register_resource(nullptr).valid());
+
+    int fired = 0;
+    gc.add_trigger(VkSemaphore(VK_NULL_HANDLE), 1, [&](){ fired++; });
+    gc.add_trigger(VkFence(VK_NULL_HANDLE), [&](){ fired++; });
+    CHECK(fired == 2);
+    gc.release((void*)nullptr, d.cleanup(nullptr));
+    gc.release_recyclable((void*)nullptr, 1, 64, d.cleanup(nullptr));
+    CHECK(d.order.size() == 2);
+    CHECK(gc.explain(nullptr).reason == vkgc::explanation::NOT_TRACKED);
+    CHECK(gc.wait_destroyed(nullptr, 0) == VK_SUCCESS);
+
+    // Only the depend_many() gave res(1) a user.
+    gc.release(res(1), d.cleanup(res(1)));
+    CHECK(d.order.size() == 2);
+    gc.release(res(2), d.cleanup(res(2)));
+    gc.collect();
+    CHECK(d.order.size() == 4);
+    CHECK(d.before(res(2), res(1)));
+    CHECK(gc.report(std::chrono::seconds(0)).empty());
+    gc.release(sem);
+}
+
+void test_empty_cleanup()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    gc.set_leak_handler([](const vkgc::garbage_collector::leak_report&){});
+    destroy_order d;
+
+    // Without a cleanup, nothing counts as released.
+    gc.depend(res(1), res(2));
+    gc.release(res(1), d.cleanup(res(1)));
+    gc.release(res(2), nullptr);
+    gc.release_recyclable(res(3), 1, 64, nullptr);
+    gc.collect();
+    CHECK(d.order.empty());
+    vkgc::leak_report left = gc.report(std::chrono::seconds(0));
+    CHECK(left.unreleased.size() == 2);
+
+    gc.teardown();
+    CHECK(d.order.empty());
+    CHECK(gc.report(std::chrono::seconds(0)).unreleased.size() == 2);
+
+    gc.release(res(2), d.cleanup(res(2)));
+    gc.release(res(3), d.cleanup(res(3)));
+    CHECK(d.order.size() == 3);
+    CHECK(d.before(res(2), res(1)));
+}
+
+void test_destroy_order()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+    VkSemaphore sem = dev.create_timeline();
+
+    void* image = res(1);
+    void* view = res(2);
+    void* cmd = res(3);
+    gc.depend(image, view);
+    gc.depend(view, cmd);
+    gc.depend(cmd, sem, 5);
+
+    gc.release(image, d.cleanup(image));
+    gc.release(view, d.cleanup(view));
+    gc.release(cmd, d.cleanup(cmd));
+    gc.collect();
+    CHECK(d.order.empty());
+
+    dev.signal(sem, 4);
+    gc.collect();
+    CHECK(d.order.empty());
+
+    dev.signal(sem, 5);
+    gc.collect();
+    CHECK(d.order.size() == 3);
+    CHECK(d.before(cmd, view));
+    CHECK(d.before(view, image));
+
+    gc.release(sem);
+    gc.collect();
+    CHECK(!dev.alive(sem));
+}
+
+void test_long_chain()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    VkSemaphore sem = dev.create_timeline();
+
+    // Deep enough to overflow the stack if the cascade recursed.
+    const uintptr_t length = 1000000;
+    for(uintptr_t i = 1; i < length; ++i)
+        gc.depend(res(i), res(i + 1));
+    gc.depend(res(length), sem, 1);
+
+    uintptr_t destroyed = 0;
+    bool in_order = true;
+    for(uintptr_t i = 1; i <= length; ++i)
+    {
+        gc.release(res(i), [&destroyed, &in_order, i](){
+            in_order = in_order && i == length - destroyed;
+            destroyed++;
+        });
+    }
+    CHECK(destroyed == 0);
+
+    dev.signal(sem, 1);
+    gc.collect();
+    CHECK(destroyed == length);
+    CHECK(in_order);
+    gc.release(sem);
+    gc.collect();
+}
+
+void test_depend_many()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+
+    void* textures[4] = {res(1), res(2), res(3), res(4)};
+    void* set = res(5);
+    gc.depend_many(textures, 4, set);
+    for(void* t: textures)
+        gc.release(t, d.cleanup(t));
+    CHECK(d.order.empty());
+
+    gc.release(set, d.cleanup(set));
+    CHECK(d.order.size() == 5);
+    CHECK(d.order[0] == set);
+}
+
+void test_resource_ids()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+    VkSemaphore sem = dev.create_timeline();
+
+    vkgc::resource_id textures[3] = {
+        gc.register_resource(res(1)),
+        gc.register_resource(res(2)),
+        gc.register_resource(res(3))
+    };
+    vkgc::resource_id set = gc.register_resource(res(4));
+    CHECK(textures[0].valid() && set.valid());
+    CHECK(gc.register_resource(res(1)).value == textures[0].value);
+    CHECK(!vkgc::resource_id().valid());
+
+    // Ids and handles refer to the same resources and can be mixed.
+    gc.depend_many(textures, 3, set);
+    gc.depend(res(4), res(5));
+    gc.depend(gc.register_resource(res(5)), sem, 1);
+    for(int i = 0; i < 3; ++i)
+        gc.release(textures[i], d.cleanup(res(i + 1)));
+    gc.release(set, d.cleanup(res(4)));
+    gc.release(res(5), d.cleanup(res(5)));
+    CHECK(d.order.empty());
+    dev.signal(sem, 1);
+    gc.collect();
+    CHECK(d.order.size() == 5);
+    CHECK(d.before(res(5), res(4)) && d.before(res(4), res(1)));
+
+    // Ids of destroyed resources are ignored, even once the slot is reused.
+    vkgc::resource_id reused = gc.register_resource(res(6));
+    CHECK(reused.value != set.value && reused.value != textures[0].value);
+    gc.depend(set, reused);
+    gc.release(set, d.cleanup(res(4)));
+    gc.release(reused, d.cleanup(res(6)));
+    CHECK(d.order.size() == 6 && d.order.back() == res(6));
+
+    vkgc::resource_id fenced = gc.register_resource(res(7));
+    VkFence fence = dev.create_fence();
+    gc.depend(fenced, fence);
+    gc.depend_many(&fenced, 1, sem, 2);
+    gc.release(fenced, d.cleanup(res(7)));
+    dev.signal(fence);
+    gc.collect();
+    CHECK(d.order.size() == 6);
+    dev.signal(sem, 2);
+    gc.collect();
+    CHECK(d.order.size() == 7);
+
+    gc.release(sem);
+    gc.release_fence(fence);
+    gc.wait_collect();
+    CHECK(gc.report(std::chrono::seconds(0)).empty());
+}
+
+void test_resource_id_wraparound()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+
+    // The freed slot is reused right away, so without retiring it the stale
+    // id would match again after 256 resources.
+    vkgc::resource_id stale = gc.register_resource(res(1));
+    gc.release(stale, d.cleanup(res(1)));
+    std::vector<uint32_t> slots;
+    for(int i = 0; i < 600; ++i)
+    {
+        vkgc::resource_id id = gc.register_resource(res(2));
+        CHECK(id.valid() && id.value != stale.value);
+        // Registering again hands out the same id.
+        CHECK(gc.register_resource(res(2)).value == id.value);
+        // A stale match would make the resource depend on itself.
+        gc.depend(stale, id);
+        gc.release(id, d.cleanup(res(2)));
+        CHECK(d.order.size() == size_t(i) + 2);
+        uint32_t slot = id.value & 0xFFFFFF;
+        if(slots.empty() || slots.back() != slot)
+            slots.push_back(slot);
+    }
+    // Each slot held 256 ids before it was retired for good.
+    CHECK(slots.size() == 3);
+    CHECK(gc.report(std::chrono::seconds(0)).empty());
+}
+
+void test_reached_values()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+    VkSemaphore sem = dev.create_timeline();
+
+    gc.add_trigger(sem, 10, [](){});
+    CHECK(gc.query_value(sem) == 0);
+    dev.signal(sem, 5);
+    gc.collect();
+    CHECK(gc.query_value(sem) == 5);
+    CHECK(gc.query_value(dev.create_timeline(3)) == 0);
+
+    // Values that collect() has already seen pass are no-ops, so the
+    // resource goes away on release without another collect().
+    uint64_t calls = dev.call_count(vkgc::fake_device::GET_SEMAPHORE_COUNTER_VALUE);
+    void* used[2] = {res(1), res(2)};
+    gc.depend(res(1), sem, 4);
+    gc.depend_many(used, 2, sem, 5);
+    gc.release(res(1), d.cleanup(res(1)));
+    gc.release(res(2), d.cleanup(res(2)));
+    CHECK(d.order.size() == 2);
+    CHECK(dev.call_count(vkgc::fake_device::GET_SEMAPHORE_COUNTER_VALUE) == calls);
+
+    // The cache is only updated by collect().
+    dev.signal(sem, 10);
+    gc.depend(res(3), sem, 6);
+    gc.release(res(3), d.cleanup(res(3)));
+    CHECK(d.order.size() == 2);
+    gc.collect();
+    CHECK(d.order.size() == 3);
+
+    gc.release(sem);
+    gc.wait_collect();
+}
+
+void test_depend_many_timeline()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+    VkSemaphore sem = dev.create_timeline();
+
+    // A repeated resource waits once per occurrence.
+    void* used[4] = {res(1), res(2), res(3), res(1)};
+    gc.depend_many(used, 4, sem, 1);
+    gc.depend(res(2), sem, 2);
+    for(int i = 1; i <= 3; ++i)
+        gc.release(res(i), d.cleanup(res(i)));
+    vkgc::explanation ex = gc.explain(res(3));
+    CHECK(ex.reason == vkgc::explanation::TIMELINE && ex.wait_value == 1);
+
+    dev.signal(sem, 1);
+    gc.collect();
+    CHECK(d.order.size() == 2);
+    CHECK(std::count(d.order.begin(), d.order.end(), res(2)) == 0);
+    dev.signal(sem, 2);
+    gc.collect();
+    CHECK(d.order.size() == 3 && d.order.back() == res(2));
+
+    gc.release(sem);
+    gc.wait_collect();
+}
+
+void test_semaphore_release()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+    VkSemaphore sem = dev.create_timeline();
+
+    gc.depend(res(1), sem, 1);
+    gc.release(res(1), d.cleanup(res(1)));
+    gc.release(sem);
+    gc.collect();
+    CHECK(dev.alive(sem));
+
+    dev.signal(sem, 1);
+    gc.collect();
+    CHECK(!dev.alive(sem));
+    CHECK(d.order.size() == 1);
+    CHECK(dev.destroy_log().size() == 1);
+    CHECK(dev.error_count() == 0);
+}
+
+void test_add_trigger()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    VkSemaphore sem = dev.create_timeline();
+
+    std::vector<int> fired;
+    gc.add_trigger(sem, 3, [&](){ fired.push_back(3); });
+    gc.add_trigger(sem, 1, [&](){ fired.push_back(1); });
+    gc.add_trigger(sem, 2, [&](){ fired.push_back(2); });
+
+    dev.signal(sem, 2);
+    gc.collect();
+    CHECK((fired == std::vector<int>{1, 2}));
+
+    dev.signal(sem, 10);
+    gc.collect();
+    CHECK((fired == std::vector<int>{1, 2, 3}));
+
+    gc.release(sem);
+    gc.collect();
+}
+
+void test_wait_collect()
+{
+    vkgc::fake_device dev;
+    destroy_order d;
+    {
+        vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+        VkSemaphore sem = dev.create_timeline();
+        gc.depend(res(1), res(2));
+        gc.depend(res(2), sem, 7);
+        dev.submit(sem, 7);
+        gc.release(res(1), d.cleanup(res(1)));
+        gc.release(res(2), d.cleanup(res(2)));
+        gc.release(sem);
+
+        gc.wait_collect();
+        CHECK(d.order.size() == 2);
+        CHECK(!dev.alive(sem));
+        CHECK(gc.report(std::chrono::seconds(0)).empty());
+    }
+
+    {
+        // Only the pending value is waited for, never the whole device.
+        vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+        gc.set_leak_handler([](const vkgc::garbage_collector::leak_report&){});
+        VkSemaphore sem = dev.create_timeline();
+        VkSemaphore other = dev.create_timeline();
+        gc.depend(res(3), sem, 2);
+        gc.depend(res(4), sem, 5);
+        gc.add_trigger(other, 1, [](){});
+        dev.submit(sem, 5);
+        gc.release(res(3), d.cleanup(res(3)));
+        gc.release(res(4), d.cleanup(res(4)));
+
+        // Nothing ever signals 'other', so this times out with the trigger
+        // and the unreleased resource left over.
+        gc.depend(res(5), res(6));
+        vkgc::leak_report left;
+        CHECK(gc.wait_collect(1000000, &left) == VK_TIMEOUT);
+        CHECK(d.order.size() == 4);
+        CHECK(dev.value(sem) == 5);
+        CHECK(dev.call_count(vkgc::fake_device::DEVICE_WAIT_IDLE) == 0);
+        CHECK(left.unreleased.size() == 2);
+        CHECK(left.semaphores.size() == 1 && left.semaphores[0].timeline == other);
+
+        dev.signal(other, 1);
+        CHECK(gc.wait_collect(0, &left) == VK_SUCCESS);
+        CHECK(left.semaphores.empty());
+        gc.release(sem);
+        gc.release(other);
+        gc.release(res(5), [](){});
+        gc.release(res(6), [](){});
+        gc.wait_collect();
+    }
+    CHECK(dev.alive_semaphore_count() == 0);
+}
+
+void test_wait_destroyed()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    gc.set_leak_handler([](const vkgc::garbage_collector::leak_report&){});
+    destroy_order d;
+    VkSemaphore sem = dev.create_timeline();
+    VkSemaphore other = dev.create_timeline();
+
+    // The atlas memory waits for value 3 through its image, not for the
+    // unrelated value 9 or the other timeline.
+    void* memory = res(1);
+    void* image = res(2);
+    gc.depend(memory, image);
+    gc.depend(image, sem, 3);
+    gc.depend(res(3), sem, 9);
+    gc.depend(res(4), other, 1);
+    dev.submit(sem, 9);
+    gc.release(memory, d.cleanup(memory));
+    gc.release(image, d.cleanup(image));
+    gc.release(res(3), d.cleanup(res(3)));
+    gc.release(res(4), d.cleanup(res(4)));
+
+    CHECK(gc.wait_destroyed(memory) == VK_SUCCESS);
+    CHECK((d.order == std::vector<void*>{image, memory}));
+    CHECK(dev.value(sem) == 3);
+    CHECK(gc.wait_destroyed(memory) == VK_SUCCESS);
+
+    // Unreleased users can't be waited for.
+    gc.depend(res(5), res(6));
+    gc.release(res(5), d.cleanup(res(5)));
+    CHECK(gc.wait_destroyed(res(5)) == VK_NOT_READY);
+    CHECK(gc.wait_destroyed(res(4), 1000000) == VK_TIMEOUT);
+
+    // Pooled users are evicted.
+    gc.set_recycling_limits(std::chrono::hours(1), SIZE_MAX);
+    gc.depend(res(7), res(8));
+    gc.release(res(7), d.cleanup(res(7)));
+    gc.release_recyclable(res(8), 42, 128, d.cleanup(res(8)));
+    CHECK(gc.wait_destroyed(res(7), 0) == VK_SUCCESS);
+    CHECK(d.before(res(8), res(7)));
+    CHECK(gc.acquire(42) == nullptr);
+
+    dev.signal(other, 1);
+    gc.release(res(6), [](){});
+    gc.release(sem);
+    gc.release(other);
+    gc.wait_collect();
+    CHECK(d.order.size() == 7);
+    CHECK(dev.alive_semaphore_count() == 0);
+}
+
+void test_teardown()
+{
+    using dev_t = vkgc::fake_device;
+    dev_t dev;
+    destroy_order d;
+    {
+        vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+        gc.set_leak_handler([](const vkgc::garbage_collector::leak_report&){});
+        gc.set_recycling_limits(std::chrono::hours(1), SIZE_MAX);
+        // The device is lost, so nothing submitted ever finishes.
+        VkSemaphore sem = dev.create_timeline();
+        VkCommandPool command_pool = dev.create_command_pool();
+        VkDescriptorPool descriptor_pool = dev.create_descriptor_pool();
+        VkFence fence = dev.create_fence();
+        dev.submit(sem, 9);
+        dev.submit(fence);
+
+        void* memory = res(1);
+        void* image = res(2);
+        VkCommandBuffer cmd = gc.acquire_command_buffer(command_pool);
+        VkDescriptorSet set = (VkDescriptorSet)res(3);
+        gc.depend(memory, image);
+        gc.depend(image, set);
+        gc.depend(set, cmd);
+        gc.depend(image, cmd);
+        gc.depend(cmd, sem, 5);
+        gc.depend(res(4), fence);
+        std::vector<int> fired;
+        gc.add_trigger(sem, 9, [&](){ fired.push_back(9); });
+        gc.add_trigger(sem, 3, [&](){ fired.push_back(3); });
+        gc.release(memory, d.cleanup(memory));
+        gc.release(image, d.cleanup(image));
+        gc.release(set, descriptor_pool);
+        gc.release(cmd, command_pool);
+        gc.release(res(4), d.cleanup(res(4)));
+        gc.release_recyclable(res(5), 1, 64, d.cleanup(res(5)));
+        gc.release_command_pool(command_pool);
+        gc.release_recyclable(descriptor_pool, 1);
+        gc.release_fence(fence);
+        gc.release(sem);
+
+        // Something unreleased keeps its dependencies alive.
+        gc.depend(res(7), res(6));
+        gc.release(res(7), d.cleanup(res(7)));
+
+        gc.teardown();
+        CHECK(dev.call_count(dev_t::GET_SEMAPHORE_COUNTER_VALUE) == 0);
+        CHECK(dev.call_count(dev_t::WAIT_SEMAPHORES) == 0);
+        CHECK(dev.call_count(dev_t::GET_FENCE_STATUS) == 0);
+        CHECK(dev.call_count(dev_t::WAIT_FOR_FENCES) == 0);
+        CHECK((fired == std::vector<int>{3, 9}));
+        CHECK(d.order.size() == 4);
+        CHECK(d.before(image, memory));
+        CHECK(!dev.alive(sem));
+        CHECK(!dev.alive_command_pool(command_pool));
+        CHECK(!dev.alive_descriptor_pool(descriptor_pool));
+        CHECK(dev.reset_count(descriptor_pool) == 0);
+        CHECK(!dev.alive_fence(fence));
+        CHECK(gc.acquire(1) == nullptr);
+
+        vkgc::leak_report left = gc.report(std::chrono::seconds(0));
+        CHECK(left.unreleased.size() == 1 && left.unreleased[0].resource == res(6));
+        CHECK(left.stale.size() == 1 && left.stale[0].dependency_count == 1);
+
+        // The GC keeps working for what's left.
+        gc.release(res(6), d.cleanup(res(6)));
+        CHECK(d.order.size() == 6);
+        CHECK(d.before(res(6), res(7)));
+        CHECK(gc.report(std::chrono::seconds(0)).empty());
+    }
+    // Only 'sem' and 'fence' were destroyed with work pending, which is fine
+    // once the device is lost.
+    CHECK(dev.error_count() == 2);
+}
+
+void test_explain()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    gc.set_leak_handler([](const vkgc::garbage_collector::leak_report&){});
+    VkSemaphore sem = dev.create_timeline(1290);
+
+    void* image = res(1);
+    void* view = res(2);
+    void* set = res(3);
+    void* cmd = res(4);
+    gc.depend(image, view);
+    gc.depend(view, set);
+    gc.depend(set, cmd);
+    gc.depend(cmd, sem, 1337);
+    gc.release(image, [](){});
+    gc.release(view, [](){});
+    gc.release(cmd, [](){});
+
+    vkgc::garbage_collector::explanation ex = gc.explain(image);
+    CHECK(ex.reason == ex.NOT_RELEASED);
+    CHECK((ex.chain == std::vector<void*>{image, view, set}));
+
+    gc.release(set, [](){});
+    ex = gc.explain(image);
+    CHECK(ex.reason == ex.TIMELINE);
+    CHECK((ex.chain == std::vector<void*>{image, view, set, cmd}));
+    CHECK(ex.timeline == sem);
+    CHECK(ex.wait_value == 1337);
+    CHECK(ex.current_value == 1290);
+
+    VkFence fence = dev.create_fence();
+    gc.depend(res(5), res(6));
+    gc.depend(res(6), fence);
+    gc.release(res(5), [](){});
+    gc.release(res(6), [](){});
+    ex = gc.explain(res(5));
+    CHECK(ex.reason == ex.FENCE);
+    CHECK((ex.chain == std::vector<void*>{res(5), res(6)}));
+    CHECK(ex.fence == fence);
+
+    CHECK(gc.explain(res(100)).reason == ex.NOT_TRACKED);
+}
+
+void test_leak_report()
+{
+    vkgc::fake_device dev;
+    VkSemaphore sem = dev.create_timeline();
+    vkgc::garbage_collector::leak_report final_report;
+    {
+        vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+        gc.set_leak_handler([&](const vkgc::garbage_collector::leak_report& r){
+            final_report = r;
+        });
+        gc.depend(res(1), res(2));
+        gc.depend(res(2), sem, 1);
+        gc.release(res(2), [](){});
+
+        vkgc::garbage_collector::leak_report r = gc.report(std::chrono::hours(1));
+        CHECK(r.unreleased.size() == 1);
+        CHECK(r.stale.empty());
+        CHECK(r.semaphores.empty());
+
+        r = gc.report(std::chrono::seconds(0));
+        CHECK(r.stale.size() == 1);
+        CHECK(r.semaphores.size() == 1);
+    }
+    CHECK(final_report.unreleased.size() == 1);
+    CHECK(final_report.stale.size() == 1);
+    CHECK(final_report.semaphores.size() == 1);
+    CHECK(!final_report.semaphores[0].released);
+}
+
+void test_recycling()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+    VkSemaphore sem = dev.create_timeline();
+    gc.set_recycling_limits(std::chrono::hours(1), 256);
+
+    void* memory = res(1);
+    void* buffer = res(2);
+    gc.depend(memory, buffer);
+    gc.depend(buffer, sem, 1);
+    gc.release(memory, d.cleanup(memory));
+    gc.release_recyclable(buffer, 42, 128, d.cleanup(buffer));
+    CHECK(gc.acquire(42) == nullptr);
+
+    dev.signal(sem, 1);
+    gc.collect();
+    CHECK(d.order.empty());
+    CHECK(gc.explain(buffer).reason == vkgc::explanation::POOLED);
+    vkgc::explanation ex = gc.explain(memory);
+    CHECK(ex.reason == ex.POOLED);
+    CHECK((ex.chain == std::vector<void*>{memory, buffer}));
+    // Only the memory is pending, the pooled buffer isn't a leak.
+    CHECK(gc.report(std::chrono::seconds(0)).stale.size() == 1);
+    CHECK(gc.acquire(7) == nullptr);
+    // 0 marks empty slots of the key map, it must not find anything.
+    CHECK(gc.acquire(0) == nullptr);
+    CHECK(gc.acquire(42) == buffer);
+    CHECK(gc.acquire(42) == nullptr);
+
+    // Going over the memory cap evicts the oldest entry, and its memory with
+    // it.
+    gc.release_recyclable(buffer, 42, 128, d.cleanup(buffer));
+    gc.release_recyclable(res(3), 43, 128, d.cleanup(res(3)));
+    CHECK(d.order.empty());
+    gc.release_recyclable(res(4), 43, 128, d.cleanup(res(4)));
+    CHECK((d.order == std::vector<void*>{buffer, memory}));
+    CHECK(gc.acquire(43) == res(4));
+    gc.release(res(4), d.cleanup(res(4)));
+    CHECK(d.order.size() == 3);
+
+    gc.set_recycling_limits(std::chrono::seconds(0), SIZE_MAX);
+    gc.collect();
+    CHECK(d.order.size() == 4);
+    CHECK(d.order.back() == res(3));
+
+    // Key 0 is reserved, so the resource isn't pooled.
+    gc.release_recyclable(res(5), 0, 16, d.cleanup(res(5)));
+    CHECK(d.order.size() == 5);
+    CHECK(gc.acquire(0) == nullptr);
+
+    gc.release(sem);
+    gc.wait_collect();
+}
+
+void test_command_buffers()
+{
+    using dev_t = vkgc::fake_device;
+    dev_t dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    VkSemaphore sem = dev.create_timeline();
+    VkCommandPool pool = dev.create_command_pool();
+
+    VkCommandBuffer a = gc.acquire_command_buffer(pool);
+    VkCommandBuffer b = gc.acquire_command_buffer(pool);
+    CHECK(a != VK_NULL_HANDLE && b != VK_NULL_HANDLE && a != b);
+    gc.depend(a, sem, 1);
+    gc.depend(b, sem, 2);
+    gc.release(a, pool);
+    gc.release(b, pool);
+    dev.signal(sem, 1);
+    gc.collect();
+
+    // 'b' is still pending, so the pool can't be reset yet, and 'a' can only
+    // be reused if the pool allows resetting it alone.
+    VkCommandBuffer c = gc.acquire_command_buffer(pool);
+    CHECK(c != a && c != b);
+    CHECK(gc.acquire_command_buffer(
+        pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
+    ) == a);
+    CHECK(dev.reset_count(a) == 1);
+    gc.release(a, pool);
+    gc.release(c, pool);
+
+    // Once everything is back, the whole pool is reset with one call.
+    dev.signal(sem, 2);
+    gc.collect();
+    VkCommandBuffer cmds[3];
+    for(VkCommandBuffer& cmd: cmds)
+        cmd = gc.acquire_command_buffer(pool);
+    CHECK(dev.call_count(dev_t::ALLOCATE_COMMAND_BUFFERS) == 3);
+    CHECK(dev.call_count(dev_t::RESET_COMMAND_BUFFER) == 1);
+    CHECK(dev.call_count(dev_t::RESET_COMMAND_POOL) == 1);
+    CHECK(dev.reset_count(b) == 1);
+    CHECK(dev.command_buffer_count(pool) == 3);
+
+    // The pool outlives its last pending command buffer.
+    gc.depend(cmds[0], sem, 3);
+    for(VkCommandBuffer cmd: cmds)
+        gc.release(cmd, pool);
+    gc.release_command_pool(pool);
+    CHECK(dev.alive_command_pool(pool));
+    dev.signal(sem, 3);
+    gc.collect();
+    CHECK(!dev.alive_command_pool(pool));
+    CHECK(gc.report(std::chrono::seconds(0)).empty());
+
+    gc.release(sem);
+    gc.wait_collect();
+    CHECK(dev.error_count() == 0);
+}
+
+void test_descriptor_pools()
+{
+    using dev_t = vkgc::fake_device;
+    dev_t dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    VkSemaphore sem = dev.create_timeline();
+    VkDescriptorPool pool = dev.create_descriptor_pool();
+    CHECK(gc.acquire_descriptor_pool(1) == VK_NULL_HANDLE);
+
+    VkDescriptorSet sets[3] = {
+        (VkDescriptorSet)res(1), (VkDescriptorSet)res(2), (VkDescriptorSet)res(3)
+    };
+    void* cmd = res(4);
+    for(VkDescriptorSet set: sets)
+    {
+        gc.depend(set, cmd);
+        gc.release(set, pool);
+    }
+    gc.depend(cmd, sem, 1);
+    gc.release(cmd, [](){});
+    gc.release_recyclable(pool, 1);
+    CHECK(gc.acquire_descriptor_pool(1) == VK_NULL_HANDLE);
+
+    // All sets are done at once, so there's just one reset.
+    dev.signal(sem, 1);
+    gc.collect();
+    CHECK(dev.reset_count(pool) == 1);
+    CHECK(dev.call_count(dev_t::RESET_DESCRIPTOR_POOL) == 1);
+    CHECK(gc.acquire_descriptor_pool(2) == VK_NULL_HANDLE);
+    CHECK(gc.acquire_descriptor_pool(0) == VK_NULL_HANDLE);
+    CHECK(gc.acquire_descriptor_pool(1) == pool);
+    CHECK(gc.acquire_descriptor_pool(1) == VK_NULL_HANDLE);
+
+    // A pool with no released sets is recycled right away.
+    gc.release_recyclable(pool, 1);
+    CHECK(dev.reset_count(pool) == 2);
+
+    VkDescriptorPool other = dev.create_descriptor_pool();
+    gc.release(sets[0], other);
+    gc.release_descriptor_pool(other);
+    CHECK(!dev.alive_descriptor_pool(other));
+
+    // Key 0 is reserved, so the pool is destroyed instead of recycled.
+    VkDescriptorPool unkeyed = dev.create_descriptor_pool();
+    gc.release_recyclable(unkeyed, 0);
+    CHECK(!dev.alive_descriptor_pool(unkeyed));
+    CHECK(gc.acquire_descriptor_pool(0) == VK_NULL_HANDLE);
+
+    // Idle pools are destroyed once the GC is done.
+    gc.release(sem);
+    gc.wait_collect();
+    CHECK(!dev.alive_descriptor_pool(pool));
+    CHECK(dev.error_count() == 0);
+}
+
+void test_fences()
+{
+    using dev_t = vkgc::fake_device;
+    dev_t dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+
+    VkFence a = dev.create_fence();
+    VkFence b = gc.acquire_fence();
+    CHECK(b != VK_NULL_HANDLE && !dev.fence_signaled(b));
+    bool fired = false;
+    gc.depend(res(1), a);
+    gc.depend(res(2), b);
+    gc.add_trigger(b, [&](){ fired = true; });
+    gc.release(res(1), d.cleanup(res(1)));
+    gc.release(res(2), d.cleanup(res(2)));
+    gc.release_fence(a);
+    gc.release_recyclable(b);
+
+    // Nothing has signaled, so one wait for any of them is the only call.
+    gc.collect();
+    CHECK(d.order.empty());
+    CHECK(dev.call_count(dev_t::GET_FENCE_STATUS) == 0);
+
+    dev.signal(b);
+    gc.collect();
+    CHECK((d.order == std::vector<void*>{res(2)}));
+    CHECK(fired);
+    CHECK(dev.call_count(dev_t::RESET_FENCES) == 1);
+    CHECK(!dev.fence_signaled(b));
+    CHECK(gc.acquire_fence() == b);
+    CHECK(dev.call_count(dev_t::CREATE_FENCE) == 1);
+
+    // wait_collect() waits for the submitted fences, and destroys them since
+    // they were released.
+    dev.submit(a);
+    dev.submit(b);
+    gc.release_recyclable(b);
+    gc.wait_collect();
+    CHECK(d.order.size() == 2);
+    CHECK(dev.call_count(dev_t::WAIT_FOR_FENCES) >= 2);
+    CHECK(!dev.alive_fence(a));
+    CHECK(!dev.alive_fence(b));
+    CHECK(dev.error_count() == 0);
+}
+
+void test_release_fence_without_triggers()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+
+    // Nothing depends on the fences, but they still have to signal before
+    // they can go.
+    VkFence destroyed = dev.create_fence();
+    VkFence recycled = dev.create_fence();
+    dev.submit(destroyed);
+    dev.submit(recycled);
+    gc.release_fence(destroyed);
+    gc.release_recyclable(recycled);
+    gc.collect();
+    CHECK(dev.alive_fence(destroyed));
+
+    gc.wait_collect();
+    CHECK(!dev.alive_fence(destroyed));
+    CHECK(!dev.alive_fence(recycled));
+    CHECK(dev.alive_fence_count() == 0);
+    CHECK(dev.error_count() == 0);
+}
+
+void test_submit()
+{
+    using dev_t = vkgc::fake_device;
+    dev_t dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+    VkQueue queue = dev.queue();
+    CHECK(gc.get_queue_timeline(queue) == VK_NULL_HANDLE);
+
+    VkCommandBufferSubmitInfo cmds[3] = {};
+    for(int i = 0; i < 3; ++i)
+        cmds[i].commandBuffer = (VkCommandBuffer)res(i + 1);
+    VkSubmitInfo2 submits[2] = {};
+    submits[0].commandBufferInfoCount = 2;
+    submits[0].pCommandBufferInfos = cmds;
+    submits[1].commandBufferInfoCount = 1;
+    submits[1].pCommandBufferInfos = cmds + 2;
+    CHECK(gc.submit(queue, 2, submits) == VK_SUCCESS);
+    CHECK(dev.submitted_command_buffer_count() == 3);
+
+    uint64_t value = 0;
+    VkSemaphore timeline = gc.get_queue_timeline(queue, &value);
+    CHECK(timeline != VK_NULL_HANDLE && value == 1);
+    CHECK(dev.call_count(dev_t::CREATE_SEMAPHORE) == 1);
+
+    // A second submit reuses the timeline with the next value.
+    VkFence fence = dev.create_fence();
+    CHECK(gc.submit(queue, 0, nullptr, fence) == VK_SUCCESS);
+    gc.get_queue_timeline(queue, &value);
+    CHECK(value == 2);
+    CHECK(dev.call_count(dev_t::CREATE_SEMAPHORE) == 1);
+
+    for(int i = 0; i < 3; ++i)
+        gc.release(res(i + 1), d.cleanup(res(i + 1)));
+    gc.collect();
+    CHECK(d.order.empty());
+
+    dev.finish();
+    gc.collect();
+    CHECK(d.order.size() == 3);
+    CHECK(dev.fence_signaled(fence));
+    CHECK(dev.value(timeline) == 2);
+
+    // wait_collect() gets rid of the queue timeline.
+    gc.wait_collect();
+    CHECK(!dev.alive(timeline));
+    CHECK(gc.report(std::chrono::seconds(0)).empty());
+    CHECK(dev.error_count() == 0);
+}
+
+void test_submit_wait_collect()
+{
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+    destroy_order d;
+    VkQueue queue = dev.queue();
+
+    VkCommandBufferSubmitInfo cmd = {};
+    cmd.commandBuffer = (VkCommandBuffer)res(1);
+    VkSubmitInfo2 submit = {};
+    submit.commandBufferInfoCount = 1;
+    submit.pCommandBufferInfos = &cmd;
+    CHECK(gc.submit(queue, 1, &submit) == VK_SUCCESS);
+    gc.release(res(1), d.cleanup(res(1)));
+    // No command buffers, so nothing depends on its value.
+    CHECK(gc.submit(queue, 0, nullptr) == VK_SUCCESS);
+    VkSemaphore timeline = gc.get_queue_timeline(queue);
+
+    // The timeline may only go once the empty submit has signaled it too.
+    gc.wait_collect();
+    CHECK(d.order.size() == 1);
+    CHECK(!dev.alive(timeline));
+    CHECK(gc.report(std::chrono::seconds(0)).empty());
+    CHECK(dev.error_count() == 0);
+}
+
+// Stateful allocator that counts what the GC allocates through it.
+struct allocation_counter
+{
+    size_t allocations = 0;
+    size_t live_bytes = 0;
+};
+
+template<typename T>
+struct counting_allocator
+{
+    using value_type = T;
+
+    allocation_counter* counter;
+
+    counting_allocator(allocation_counter* counter): counter(counter) {}
+    template<typename U>
+    counting_allocator(const counting_allocator<U>& other): counter(other.counter) {}
+
+    T* allocate(size_t n)
+    {
+        counter->allocations++;
+        counter->live_bytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        counter->live_bytes -= n * sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template<typename U>
+    bool operator==(const counting_allocator<U>& other) const { return counter == other.counter; }
+    template<typename U>
+    bool operator!=(const counting_allocator<U>& other) const { return counter != other.counter; }
+};
+
+struct counting_traits: vkgc::default_traits
+{
+    template<typename T>
+    using allocator = counting_allocator<T>;
+
+    template<typename K, typename V>
+    using map = std::unordered_map<
+        K, V, std::hash<K>, std::equal_to<K>, allocator<std::pair<const K, V>>
+    >;
+
+    template<typename T>
+    using vector = std::vector<T, allocator<T>>;
+
+    template<typename T>
+    using trigger_queue = vector<T>;
+};
+
+void test_allocator()
+{
+    vkgc::fake_device dev;
+    allocation_counter counter;
+    {
+        vkgc::basic_garbage_collector<counting_traits> gc(
+            dev.device(), dev.dispatch(), &counter
+        );
+        CHECK(gc.get_allocator().counter == &counter);
+        VkSemaphore sem = dev.create_timeline();
+        void* used[3] = {res(1), res(2), res(3)};
+        gc.depend_many(used, 3, res(4));
+        gc.depend(res(4), sem, 1);
+        CHECK(counter.allocations != 0);
+        CHECK(counter.live_bytes != 0);
+
+        for(void* r: used)
+            gc.release(r, [](){});
+        gc.release(res(4), [](){});
+        gc.release(sem);
+        dev.signal(sem, 1);
+        gc.collect();
+    }
+    CHECK(counter.live_bytes == 0);
+}
+
+#if VKGC_TRACING
+void test_recording()
+{
+    const char* path = "vkgc_test_trace.bin";
+    vkgc::fake_device dev;
+    {
+        vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+        VkSemaphore sem = dev.create_timeline();
+        CHECK(gc.start_recording(path));
+        void* used[2] = {res(1), res(2)};
+        gc.depend_many(used, 2, res(3));
+        gc.depend(res(3), sem, 1);
+        gc.release(res(3), [](){});
+        dev.signal(sem, 1);
+        gc.collect();
+        gc.release(sem);
+        gc.stop_recording();
+        gc.collect();
+        gc.release(res(1), [](){});
+        gc.release(res(2), [](){});
+    }
+
+    std::ifstream f(path, std::ios::binary);
+    std::vector<uint8_t> data(
+        (std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>()
+    );
+    if(!keep_traces)
+        std::remove(path);
+
+    vkgc::trace_reader reader(data.data(), data.size());
+    vkgc::trace_reader::record r;
+    std::vector<vkgc::trace_op> ops;
+    while(reader.next(r))
+    {
+        ops.push_back(r.op);
+        CHECK(r.thread == 0);
+        if(r.op == vkgc::TRACE_DEPEND_MANY)
+        {
+            CHECK(reader.read() == 0); // res(3)
+            CHECK(reader.read() == 2);
+            CHECK(reader.read() == 1); // res(1)
+            CHECK(reader.read() == 2); // res(2)
+        }
+        else if(r.op == vkgc::TRACE_DEPEND_TIMELINE)
+        {
+            CHECK(reader.read() == 0);
+            CHECK(reader.read() == 0); // sem
+            CHECK(reader.read() == 1);
+        }
+        else if(r.op == vkgc::TRACE_OBSERVE)
+        {
+            CHECK(reader.read() == 0);
+            CHECK(reader.read() == 1);
+        }
+        else if(r.op != vkgc::TRACE_COLLECT)
+            reader.read();
+    }
+    CHECK(reader.valid());
+    CHECK((ops == std::vector<vkgc::trace_op>{
+        vkgc::TRACE_DEPEND_MANY, vkgc::TRACE_DEPEND_TIMELINE,
+        vkgc::TRACE_RELEASE, vkgc::TRACE_COLLECT, vkgc::TRACE_OBSERVE,
+        vkgc::TRACE_RELEASE_SEMAPHORE
+    }));
+}
+
+void test_recording_objects()
+{
+    const char* path = "vkgc_test_objects_trace.bin";
+    vkgc::fake_device dev;
+    {
+        vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+        VkCommandPool pool = dev.create_command_pool();
+        VkDescriptorPool descriptor_pool = dev.create_descriptor_pool();
+        CHECK(gc.start_recording(path));
+        VkCommandBuffer cmd = gc.acquire_command_buffer(pool);
+        VkFence fence = gc.acquire_fence();
+        VkCommandBufferSubmitInfo cmd_info = {};
+        cmd_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+        cmd_info.commandBuffer = cmd;
+        VkSubmitInfo2 submit = {};
+        submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submit.commandBufferInfoCount = 1;
+        submit.pCommandBufferInfos = &cmd_info;
+        CHECK(gc.submit(dev.queue(), 1, &submit, fence) == VK_SUCCESS);
+        gc.release(cmd, pool);
+        gc.release((VkDescriptorSet)res(1), descriptor_pool);
+        gc.release_descriptor_pool(descriptor_pool);
+        gc.depend(res(2), fence);
+        gc.release_recyclable(fence);
+        dev.finish();
+        gc.collect();
+        gc.release_command_pool(pool);
+        gc.stop_recording();
+        gc.release(res(2), [](){});
+        gc.wait_collect();
+    }
+
+    std::ifstream f(path, std::ios::binary);
+    std::vector<uint8_t> data(
+        (std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>()
+    );
+    if(!keep_traces)
+        std::remove(path);
+
+    vkgc::trace_reader reader(data.data(), data.size());
+    vkgc::trace_reader::record r;
+    std::vector<vkgc::trace_op> ops;
+    while(reader.next(r))
+    {
+        ops.push_back(r.op);
+        if(r.op == vkgc::TRACE_SUBMIT)
+        {
+            CHECK(reader.read() == 0); // queue
+            CHECK(reader.read() == 0); // timeline
+            CHECK(reader.read() == 1);
+            CHECK(reader.read() == 1); // fence, 0 is VK_NULL_HANDLE
+            CHECK(reader.read() == 1);
+            CHECK(reader.read() == 0); // cmd
+        }
+        else if(r.op == vkgc::TRACE_OBSERVE_FENCE)
+            CHECK(reader.read() == 1);
+        else reader.skip(r.op);
+    }
+    CHECK(reader.valid());
+    CHECK((ops == std::vector<vkgc::trace_op>{
+        vkgc::TRACE_ACQUIRE_COMMAND_BUFFER, vkgc::TRACE_ACQUIRE_FENCE,
+        vkgc::TRACE_SUBMIT, vkgc::TRACE_RELEASE_COMMAND_BUFFER,
+        vkgc::TRACE_RELEASE_DESCRIPTOR_SET, vkgc::TRACE_RELEASE_DESCRIPTOR_POOL,
+        vkgc::TRACE_DEPEND_FENCE, vkgc::TRACE_RELEASE_RECYCLABLE_FENCE,
+        vkgc::TRACE_COLLECT, vkgc::TRACE_OBSERVE, vkgc::TRACE_OBSERVE_FENCE,
+        vkgc::TRACE_RELEASE_COMMAND_POOL
+    }));
+}
+#endif
+
+}
+
+int main(int argc, char** argv)
+{
+    for(int i = 1; i < argc; ++i)
+        keep_traces |= !std::strcmp(argv[i], "--keep-traces");
+
+    test_release_without_dependencies();
+    test_null_handles();
+    test_empty_cleanup();
+    test_destroy_order();
+    test_long_chain();
+    test_depend_many();
+    test_depend_many_timeline();
+    test_resource_ids();
+    test_resource_id_wraparound();
+    test_reached_values();
+    test_semaphore_release();
+    test_add_trigger();
+    test_wait_collect();
+    test_wait_destroyed();
+    test_teardown();
+    test_explain();
+    test_leak_report();
+    test_recycling();
+    test_command_buffers();
+    test_descriptor_pools();
+    test_fences();
+    test_release_fence_without_triggers();
+    test_submit();
+    test_submit_wait_collect();
+    test_allocator();
+#if VKGC_TRACING
+    test_recording();
+    test_recording_objects();
+#endif
+
+    if(failures != 0)
+    {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
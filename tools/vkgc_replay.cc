@@ -0,0 +1,621 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+// Replays a call trace recorded with garbage_collector::start_recording()
+// against a fresh GC on the fake device, and reports how long the GC calls
+// took as JSON. Semaphore values are replayed exactly as the recording GC saw
+// them, so the same resources are destroyed at the same points.
+//
+// Calls from all recorded threads are replayed on one thread, in the order the
+// recording GC executed them. Command pools, descriptor pools, fences and
+// queues are created on the fake device as they come up, and the handles
+// acquire_command_buffer() and acquire_fence() return stand in for the recorded
+// ones from then on. The blocking waits of wait_collect() aren't replayed, so
+// queue timelines are never released; the values they were observed at are
+// shifted to match.
+//
+// Usage: vkgc_replay <trace> [--iterations <n>] [--out <file.json>]
+#include "vkgc_fake.hh"
+#include "vkgc_trace.hh"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+const char* op_names[vkgc::TRACE_OP_COUNT] = {
+    "", "depend", "depend_many", "depend_timeline", "release",
+    "release_semaphore", "add_trigger", "collect", "observe", "wait_idle",
+    "release_recyclable", "acquire", "release_command_buffer",
+    "acquire_command_buffer", "release_command_pool", "release_descriptor_set",
+    "release_recyclable_descriptor_pool", "acquire_descriptor_pool",
+    "release_descriptor_pool", "depend_fence", "add_fence_trigger",
+    "release_fence", "release_recyclable_fence", "acquire_fence",
+    "observe_fence", "submit"
+};
+
+// Read-only view of the whole trace file.
+class mapped_file
+{
+public:
+    mapped_file(const char* path)
+    : data(nullptr), size(0)
+    {
+#ifdef _WIN32
+        std::ifstream f(path, std::ios::binary);
+        if(!f) return;
+        copy.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+        data = (const uint8_t*)copy.data();
+        size = copy.size();
+#else
+        int fd = open(path, O_RDONLY);
+        if(fd < 0) return;
+        struct stat st;
+        if(fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(ptr != MAP_FAILED)
+            {
+                data = (const uint8_t*)ptr;
+                size = st.st_size;
+                madvise(ptr, size, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+#endif
+    }
+
+    ~mapped_file()
+    {
+#ifndef _WIN32
+        if(data)
+            munmap((void*)data, size);
+#endif
+    }
+
+    const uint8_t* data;
+    size_t size;
+
+private:
+#ifdef _WIN32
+    std::vector<char> copy;
+#endif
+};
+
+struct op_stats
+{
+    uint64_t count = 0;
+    uint64_t ns = 0;
+};
+
+struct replay_result
+{
+    bool ok = true;
+    op_stats ops[vkgc::TRACE_OP_COUNT];
+    uint64_t destroyed = 0;
+    uint64_t triggers = 0;
+    uint64_t threads = 0;
+    uint64_t recorded_ns = 0;
+};
+
+class replayer
+{
+public:
+    replayer()
+    : gc(dev.device(), dev.dispatch()), backing_pool(dev.create_command_pool())
+    {
+        gc.set_leak_handler([](const vkgc::garbage_collector::leak_report&){});
+    }
+
+    replay_result run(const uint8_t* data, size_t size)
+    {
+        replay_result res;
+        find_command_buffers(data, size);
+        vkgc::trace_reader reader(data, size);
+        vkgc::trace_reader::record r, observed;
+        std::unordered_set<uint64_t> threads;
+        std::vector<void*> used;
+        std::vector<VkCommandBufferSubmitInfo> cmds;
+        while(reader.next(r))
+        {
+            threads.insert(r.thread);
+            res.recorded_ns = r.time_ns;
+
+            clock_type::time_point start;
+            switch(r.op)
+            {
+            case vkgc::TRACE_DEPEND:
+            {
+                void* used = resource(reader.read());
+                void* user = resource(reader.read());
+                start = clock_type::now();
+                gc.depend(used, user);
+                break;
+            }
+            case vkgc::TRACE_DEPEND_MANY:
+            {
+                void* user = resource(reader.read());
+                used.resize(reader.read());
+                for(void*& res: used)
+                    res = resource(reader.read());
+                start = clock_type::now();
+                gc.depend_many(used.data(), used.size(), user);
+                break;
+            }
+            case vkgc::TRACE_DEPEND_TIMELINE:
+            {
+                void* used = resource(reader.read());
+                VkSemaphore sem = semaphore(reader.read());
+                uint64_t value = reader.read();
+                start = clock_type::now();
+                gc.depend(used, sem, value);
+                break;
+            }
+            case vkgc::TRACE_RELEASE:
+            {
+                void* res = resource(reader.read());
+                uint64_t& destroyed = this->destroyed;
+                start = clock_type::now();
+                gc.release(res, [&destroyed](){ destroyed++; });
+                break;
+            }
+            case vkgc::TRACE_RELEASE_SEMAPHORE:
+            {
+                VkSemaphore sem = semaphore(reader.read());
+                start = clock_type::now();
+                gc.release(sem);
+                break;
+            }
+            case vkgc::TRACE_ADD_TRIGGER:
+            {
+                VkSemaphore sem = semaphore(reader.read());
+                uint64_t value = reader.read();
+                uint64_t& triggers = this->triggers;
+                start = clock_type::now();
+                gc.add_trigger(sem, value, [&triggers](){ triggers++; });
+                break;
+            }
+            case vkgc::TRACE_COLLECT:
+                // The values and fences this collect() saw follow it in the
+                // trace.
+                while(
+                    (reader.peek() == vkgc::TRACE_OBSERVE ||
+                    reader.peek() == vkgc::TRACE_OBSERVE_FENCE) &&
+                    reader.next(observed)
+                ) observe(reader, observed.op);
+                start = clock_type::now();
+                gc.collect();
+                break;
+            case vkgc::TRACE_OBSERVE:
+            case vkgc::TRACE_OBSERVE_FENCE:
+                observe(reader, r.op);
+                continue;
+            case vkgc::TRACE_RELEASE_RECYCLABLE:
+            {
+                void* res = resource(reader.read());
+                uint64_t key = reader.read();
+                size_t size = reader.read();
+                uint64_t& destroyed = this->destroyed;
+                start = clock_type::now();
+                gc.release_recyclable(res, key, size, [&destroyed](){ destroyed++; });
+                break;
+            }
+            case vkgc::TRACE_ACQUIRE:
+            {
+                uint64_t key = reader.read();
+                start = clock_type::now();
+                gc.acquire(key);
+                break;
+            }
+            case vkgc::TRACE_RELEASE_COMMAND_BUFFER:
+            {
+                VkCommandBuffer cmd = (VkCommandBuffer)resource(reader.read());
+                VkCommandPool pool = command_pool(reader.read());
+                VkCommandBufferLevel level = (VkCommandBufferLevel)reader.read();
+                start = clock_type::now();
+                gc.release(cmd, pool, level);
+                break;
+            }
+            case vkgc::TRACE_ACQUIRE_COMMAND_BUFFER:
+            {
+                VkCommandPool pool = command_pool(reader.read());
+                VkCommandBufferLevel level = (VkCommandBufferLevel)reader.read();
+                VkCommandPoolCreateFlags flags = (VkCommandPoolCreateFlags)reader.read();
+                void*& cmd = bound_resource(reader.read());
+                start = clock_type::now();
+                cmd = gc.acquire_command_buffer(pool, level, flags);
+                break;
+            }
+            case vkgc::TRACE_RELEASE_COMMAND_POOL:
+            {
+                VkCommandPool pool = command_pool(reader.read());
+                start = clock_type::now();
+                gc.release_command_pool(pool);
+                break;
+            }
+            case vkgc::TRACE_RELEASE_DESCRIPTOR_SET:
+            {
+                VkDescriptorSet set = (VkDescriptorSet)resource(reader.read());
+                VkDescriptorPool pool = descriptor_pool(reader.read());
+                start = clock_type::now();
+                gc.release(set, pool);
+                break;
+            }
+            case vkgc::TRACE_RELEASE_RECYCLABLE_DESCRIPTOR_POOL:
+            {
+                VkDescriptorPool pool = descriptor_pool(reader.read());
+                uint64_t key = reader.read();
+                start = clock_type::now();
+                gc.release_recyclable(pool, key);
+                break;
+            }
+            case vkgc::TRACE_ACQUIRE_DESCRIPTOR_POOL:
+            {
+                uint64_t key = reader.read();
+                start = clock_type::now();
+                gc.acquire_descriptor_pool(key);
+                break;
+            }
+            case vkgc::TRACE_RELEASE_DESCRIPTOR_POOL:
+            {
+                VkDescriptorPool pool = descriptor_pool(reader.read());
+                start = clock_type::now();
+                gc.release_descriptor_pool(pool);
+                break;
+            }
+            case vkgc::TRACE_DEPEND_FENCE:
+            {
+                void* used = resource(reader.read());
+                VkFence fence = this->fence(reader.read());
+                start = clock_type::now();
+                gc.depend(used, fence);
+                break;
+            }
+            case vkgc::TRACE_ADD_FENCE_TRIGGER:
+            {
+                VkFence fence = this->fence(reader.read());
+                uint64_t& triggers = this->triggers;
+                start = clock_type::now();
+                gc.add_trigger(fence, [&triggers](){ triggers++; });
+                break;
+            }
+            case vkgc::TRACE_RELEASE_FENCE:
+            {
+                VkFence fence = this->fence(reader.read());
+                start = clock_type::now();
+                gc.release_fence(fence);
+                break;
+            }
+            case vkgc::TRACE_RELEASE_RECYCLABLE_FENCE:
+            {
+                VkFence fence = this->fence(reader.read());
+                start = clock_type::now();
+                gc.release_recyclable(fence);
+                break;
+            }
+            case vkgc::TRACE_ACQUIRE_FENCE:
+            {
+                VkFence& fence = bound_fence(reader.read());
+                start = clock_type::now();
+                fence = gc.acquire_fence();
+                break;
+            }
+            case vkgc::TRACE_SUBMIT:
+            {
+                VkQueue queue = dev.queue((uint32_t)reader.read());
+                submitted_timeline = reader.read();
+                submitted_value = reader.read();
+                VkFence fence = this->fence(reader.read());
+                cmds.resize(reader.read());
+                for(VkCommandBufferSubmitInfo& cmd: cmds)
+                {
+                    cmd = {};
+                    cmd.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+                    cmd.commandBuffer = (VkCommandBuffer)resource(reader.read());
+                }
+                VkSubmitInfo2 submit = {};
+                submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+                submit.commandBufferInfoCount = (uint32_t)cmds.size();
+                submit.pCommandBufferInfos = cmds.data();
+                submitted_queue = queue;
+                start = clock_type::now();
+                gc.submit(queue, 1, &submit, fence);
+                break;
+            }
+            case vkgc::TRACE_WAIT_IDLE:
+                // The values after the idle wait are observed by the
+                // following collect().
+                continue;
+            default:
+                break;
+            }
+            auto end = clock_type::now();
+            res.ops[r.op].count++;
+            res.ops[r.op].ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            if(r.op == vkgc::TRACE_SUBMIT)
+                bind_timeline();
+        }
+        res.ok = reader.valid();
+        res.destroyed = destroyed;
+        res.triggers = triggers;
+        res.threads = threads.size();
+        return res;
+    }
+
+private:
+    void* resource(uint64_t id)
+    {
+        if(id < resources.size() && resources[id])
+            return resources[id];
+        if(id < command_buffers.size() && command_buffers[id])
+            return bound_resource(id) = dev.allocate_command_buffer(backing_pool);
+        return (void*)((id + 1) * 16);
+    }
+
+    // Resources that stand for what an acquire returned.
+    void*& bound_resource(uint64_t id)
+    {
+        if(id >= resources.size())
+            resources.resize(id + 1, nullptr);
+        return resources[id];
+    }
+
+    // vkResetCommandBuffer() dereferences the command buffer, so the ones
+    // the app allocated itself need real fake ones. Those are taken from a
+    // pool of their own, as it doesn't matter to the GC.
+    void find_command_buffers(const uint8_t* data, size_t size)
+    {
+        vkgc::trace_reader reader(data, size);
+        vkgc::trace_reader::record r;
+        auto mark = [&](uint64_t id){
+            if(id >= command_buffers.size())
+                command_buffers.resize(id + 1, 0);
+            command_buffers[id] = 1;
+        };
+        while(reader.next(r))
+        {
+            if(r.op == vkgc::TRACE_RELEASE_COMMAND_BUFFER)
+            {
+                mark(reader.read());
+                reader.read();
+                reader.read();
+            }
+            else if(r.op == vkgc::TRACE_SUBMIT)
+            {
+                for(int i = 0; i < 4; ++i)
+                    reader.read();
+                uint64_t count = reader.read();
+                for(uint64_t i = 0; i < count && reader.valid(); ++i)
+                    mark(reader.read());
+            }
+            else reader.skip(r.op);
+        }
+    }
+
+    // Semaphores are created on first use, and again if the handle is reused
+    // after the GC destroyed it.
+    VkSemaphore semaphore(uint64_t id)
+    {
+        if(id >= semaphores.size())
+            semaphores.resize(id + 1, VK_NULL_HANDLE);
+        VkSemaphore& sem = semaphores[id];
+        if(sem == VK_NULL_HANDLE || !dev.alive(sem))
+            sem = dev.create_timeline();
+        return sem;
+    }
+
+    VkFence fence(uint64_t id)
+    {
+        if(id == 0)
+            return VK_NULL_HANDLE;
+        VkFence& fence = bound_fence(id);
+        if(fence == VK_NULL_HANDLE || !dev.alive_fence(fence))
+            fence = dev.create_fence();
+        return fence;
+    }
+
+    VkFence& bound_fence(uint64_t id)
+    {
+        if(id >= fences.size())
+            fences.resize(id + 1, VK_NULL_HANDLE);
+        return fences[id];
+    }
+
+    VkCommandPool command_pool(uint64_t id)
+    {
+        if(id >= command_pools.size())
+            command_pools.resize(id + 1, VK_NULL_HANDLE);
+        VkCommandPool& pool = command_pools[id];
+        if(pool == VK_NULL_HANDLE || !dev.alive_command_pool(pool))
+            pool = dev.create_command_pool();
+        return pool;
+    }
+
+    VkDescriptorPool descriptor_pool(uint64_t id)
+    {
+        if(id >= descriptor_pools.size())
+            descriptor_pools.resize(id + 1, VK_NULL_HANDLE);
+        VkDescriptorPool& pool = descriptor_pools[id];
+        if(pool == VK_NULL_HANDLE || !dev.alive_descriptor_pool(pool))
+            pool = dev.create_descriptor_pool();
+        return pool;
+    }
+
+    // The recorded timeline of the submitted queue is the replaying GC's,
+    // whose values keep counting where the recording started over after
+    // wait_collect().
+    void bind_timeline()
+    {
+        uint64_t value = 0;
+        VkSemaphore timeline = gc.get_queue_timeline(submitted_queue, &value);
+        if(timeline == VK_NULL_HANDLE)
+            return;
+        if(submitted_timeline >= semaphores.size())
+            semaphores.resize(submitted_timeline + 1, VK_NULL_HANDLE);
+        if(submitted_timeline >= offsets.size())
+            offsets.resize(submitted_timeline + 1, 0);
+        semaphores[submitted_timeline] = timeline;
+        offsets[submitted_timeline] = value - submitted_value;
+    }
+
+    void observe(vkgc::trace_reader& reader, vkgc::trace_op op)
+    {
+        if(op == vkgc::TRACE_OBSERVE_FENCE)
+        {
+            dev.signal(fence(reader.read()));
+            return;
+        }
+        uint64_t id = reader.read();
+        uint64_t offset = id < offsets.size() ? offsets[id] : 0;
+        dev.signal(semaphore(id), reader.read() + offset);
+    }
+
+    vkgc::fake_device dev;
+    vkgc::garbage_collector gc;
+    VkCommandPool backing_pool;
+    std::vector<void*> resources;
+    std::vector<uint8_t> command_buffers;
+    std::vector<VkSemaphore> semaphores;
+    std::vector<uint64_t> offsets;
+    std::vector<VkFence> fences;
+    std::vector<VkCommandPool> command_pools;
+    std::vector<VkDescriptorPool> descriptor_pools;
+    VkQueue submitted_queue = VK_NULL_HANDLE;
+    uint64_t submitted_timeline = 0;
+    uint64_t submitted_value = 0;
+    uint64_t destroyed = 0;
+    uint64_t triggers = 0;
+};
+
+void write_json(std::FILE* f, const std::vector<replay_result>& results)
+{
+    const replay_result& first = results[0];
+    std::fprintf(
+        f, "{\n  \"iterations\": %zu,\n  \"threads\": %llu,\n  \"recorded_seconds\": %.6f,\n"
+        "  \"destroyed\": %llu,\n  \"triggers\": %llu,\n  \"ops\": {\n",
+        results.size(), (unsigned long long)first.threads, first.recorded_ns * 1e-9,
+        (unsigned long long)first.destroyed, (unsigned long long)first.triggers
+    );
+
+    uint64_t total_ns = 0;
+    bool first_op = true;
+    for(unsigned op = 1; op < vkgc::TRACE_OP_COUNT; ++op)
+    {
+        op_stats sum;
+        uint64_t best_ns = UINT64_MAX;
+        for(const replay_result& res: results)
+        {
+            sum.count += res.ops[op].count;
+            sum.ns += res.ops[op].ns;
+            best_ns = std::min(best_ns, res.ops[op].ns);
+        }
+        total_ns += sum.ns;
+        if(sum.count == 0)
+            continue;
+        std::fprintf(
+            f, "%s    \"%s\": {\"count\": %llu, \"ns_per_op\": %.1f, \"best_seconds\": %.9f}",
+            first_op ? "" : ",\n", op_names[op],
+            (unsigned long long)(sum.count / results.size()),
+            double(sum.ns) / sum.count, best_ns * 1e-9
+        );
+        first_op = false;
+    }
+    std::fprintf(
+        f, "\n  },\n  \"gc_seconds_per_iteration\": %.9f\n}\n",
+        total_ns * 1e-9 / results.size()
+    );
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = nullptr;
+    const char* out = nullptr;
+    unsigned iterations = 1;
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!std::strcmp(argv[i], "--iterations") && i + 1 < argc)
+            iterations = std::max(1, std::atoi(argv[++i]));
+        else if(!std::strcmp(argv[i], "--out") && i + 1 < argc)
+            out = argv[++i];
+        else if(!path && argv[i][0] != '-')
+            path = argv[i];
+        else path = nullptr, i = argc;
+    }
+    if(!path)
+    {
+        std::fprintf(stderr, "Usage: %s <trace> [--iterations <n>] [--out <file.json>]\n", argv[0]);
+        return 1;
+    }
+
+    mapped_file trace(path);
+    if(!trace.data)
+    {
+        std::fprintf(stderr, "Failed to read %s\n", path);
+        return 1;
+    }
+
+    std::vector<replay_result> results;
+    for(unsigned i = 0; i < iterations; ++i)
+    {
+        replayer r;
+        results.push_back(r.run(trace.data, trace.size));
+        if(!results.back().ok)
+        {
+            std::fprintf(stderr, "%s is not a valid trace or is truncated\n", path);
+            return 1;
+        }
+    }
+
+    std::FILE* f = out ? std::fopen(out, "w") : stdout;
+    if(!f)
+    {
+        std::fprintf(stderr, "Failed to open %s\n", out);
+        return 1;
+    }
+    write_json(f, results);
+    if(f != stdout)
+        std::fclose(f);
+    return 0;
+}
@@ -29,117 +29,100 @@ For more information, please refer to <https://unlicense.org>
 namespace vkgc
 {
 
-garbage_collector::garbage_collector(VkDevice dev)
-: dev(dev)
+#if VKGC_DEFAULT_DISPATCH
+VKGC_INLINE dispatch_table dispatch_table::global()
 {
+    dispatch_table vk;
+    vk.vkGetSemaphoreCounterValue = ::vkGetSemaphoreCounterValue;
+    vk.vkDestroySemaphore = ::vkDestroySemaphore;
+    vk.vkWaitSemaphores = ::vkWaitSemaphores;
+    vk.vkDeviceWaitIdle = ::vkDeviceWaitIdle;
+    vk.vkAllocateCommandBuffers = ::vkAllocateCommandBuffers;
+    vk.vkResetCommandBuffer = ::vkResetCommandBuffer;
+    vk.vkResetCommandPool = ::vkResetCommandPool;
+    vk.vkDestroyCommandPool = ::vkDestroyCommandPool;
+    vk.vkResetDescriptorPool = ::vkResetDescriptorPool;
+    vk.vkDestroyDescriptorPool = ::vkDestroyDescriptorPool;
+    vk.vkCreateSemaphore = ::vkCreateSemaphore;
+    vk.vkQueueSubmit2 = ::vkQueueSubmit2;
+    vk.vkCreateFence = ::vkCreateFence;
+    vk.vkGetFenceStatus = ::vkGetFenceStatus;
+    vk.vkWaitForFences = ::vkWaitForFences;
+    vk.vkResetFences = ::vkResetFences;
+    vk.vkDestroyFence = ::vkDestroyFence;
+    return vk;
 }
+#endif
 
-void garbage_collector::release(void* resource, std::function<void()>&& cleanup)
+VKGC_INLINE bool leak_report::empty() const
 {
-    std::unique_lock<std::mutex> lk(mutex);
-    resources[resource].cleanup = std::move(cleanup);
-    check_delete(resource);
+    return unreleased.empty() && stale.empty() && semaphores.empty();
 }
 
-void garbage_collector::release(VkSemaphore sem)
+static inline void print_call_site(std::FILE* f, const char* what, const call_site& site)
 {
-    std::unique_lock<std::mutex> lk(mutex);
-    semaphore_dependencies[sem].should_destroy = true;
+#if VKGC_CALL_SITES
+    if(site.file)
+        std::fprintf(f, ", %s at %s:%u (%s)", what, site.file, site.line, site.function);
+#else
+    (void)f;
+    (void)what;
+    (void)site;
+#endif
 }
 
-void garbage_collector::depend(void* used_resource, void* user_resource)
+static inline double to_seconds(std::chrono::steady_clock::duration d)
 {
-    depend_many(&used_resource, 1, user_resource);
+    return std::chrono::duration_cast<std::chrono::duration<double>>(d).count();
 }
 
-void garbage_collector::depend_many(void** used_resources, size_t used_resource_count, void* user_resource)
+VKGC_INLINE void leak_report::print(std::FILE* f) const
 {
-    std::unique_lock<std::mutex> lk(mutex);
-    auto& dependents = resources[user_resource].dependents;
-    dependents.insert(dependents.end(), used_resources, used_resources + used_resource_count);
-    for(size_t i = 0; i < used_resource_count; ++i)
-        resources[used_resources[i]].dependency_count++;
-}
-
-void garbage_collector::depend(void* used_resource, VkSemaphore timeline, uint64_t value)
-{
-    std::unique_lock<std::mutex> lk(mutex);
-    resources[used_resource].dependency_count++;
-    semaphore_info& sem = semaphore_dependencies[timeline];
-    sem.triggers.push({value, used_resource});
-}
-
-void garbage_collector::collect()
-{
-    std::unique_lock<std::mutex> lk(mutex);
-    for(auto it = semaphore_dependencies.begin(); it != semaphore_dependencies.end();)
+    std::fprintf(
+        f, "vkgc: %zu unreleased resources, %zu stale resources, %zu stalled semaphores\n",
+        unreleased.size(), stale.size(), semaphores.size()
+    );
+    for(const resource_entry& e: unreleased)
     {
-        uint64_t value = 0;
-        vkGetSemaphoreCounterValue(dev, it->first, &value);
-
-        auto& triggers = it->second.triggers;
-        while(!triggers.empty() && triggers.top().value <= value)
-        {
-            if(triggers.top().callback)
-                triggers.top().callback();
-
-            if(triggers.top().dependent)
-            {
-                resources[triggers.top().dependent].dependency_count--;
-                check_delete(triggers.top().dependent);
-            }
-            triggers.pop();
-        }
-
-        if(triggers.empty() && it->second.should_destroy)
-        {
-            vkDestroySemaphore(dev, it->first, nullptr);
-            it = semaphore_dependencies.erase(it);
-        }
-        else ++it;
+        std::fprintf(
+            f, "  unreleased %p with %zu dependencies",
+            e.resource, e.dependency_count
+        );
+        print_call_site(f, "depended", e.depended_at);
+        std::fprintf(f, "\n");
     }
-}
-
-void garbage_collector::wait_collect()
-{
-    collect();
-    std::unique_lock<std::mutex> lk(mutex);
-    if(resources.size() != 0 || semaphore_dependencies.size() != 0)
+    for(const resource_entry& e: stale)
     {
-        vkDeviceWaitIdle(dev);
-        lk.unlock();
-        collect();
+        std::fprintf(
+            f, "  stale %p with %zu dependencies, pending for %.3fs",
+            e.resource, e.dependency_count, to_seconds(e.pending_time)
+        );
+        print_call_site(f, "depended", e.depended_at);
+        print_call_site(f, "released", e.released_at);
+        std::fprintf(f, "\n");
     }
-}
-
-void garbage_collector::add_trigger(
-    VkSemaphore timeline,
-    uint64_t value,
-    std::function<void()>&& callback
-){
-    std::unique_lock<std::mutex> lk(mutex);
-    semaphore_info& sem = semaphore_dependencies[timeline];
-    sem.triggers.push({value, nullptr, std::move(callback)});
-}
-
-bool garbage_collector::trigger::operator<(const trigger& t) const
-{
-    return t.value < value;
-}
-
-void garbage_collector::check_delete(void* resource)
-{
-    auto it = resources.find(resource);
-    if(it->second.dependency_count == 0 && it->second.cleanup)
+    for(const semaphore_entry& e: semaphores)
     {
-        it->second.cleanup();
-        for(void* dep: it->second.dependents)
+        std::fprintf(
+            f, "  %s semaphore %p with %zu pending triggers",
+            e.released ? "released" : "unreleased",
+            (void*)e.timeline, e.pending_triggers
+        );
+        if(e.pending_triggers != 0)
         {
-            resources[dep].dependency_count--;
-            check_delete(dep);
+            std::fprintf(
+                f, ", waiting for %llu, stalled for %.3fs",
+                (unsigned long long)e.next_value, to_seconds(e.stalled_time)
+            );
         }
-        resources.erase(it);
+        print_call_site(f, "depended", e.depended_at);
+        print_call_site(f, "released", e.released_at);
+        std::fprintf(f, "\n");
     }
 }
 
+#ifndef VKGC_HEADER_ONLY
+template class basic_garbage_collector<default_traits>;
+#endif
+
 }
@@ -30,14 +30,348 @@ For more information, please refer to <https://unlicense.org>
 #include <vulkan/vulkan.h>
 //#include "volk.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <functional>
-#include <queue>
+#include <memory>
+#include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <mutex>
+#include <thread>
+
+// std::pmr is used for pmr_traits when it's available.
+#ifndef VKGC_PMR
+#if __cplusplus >= 201703L && __has_include(<memory_resource>)
+#define VKGC_PMR 1
+#else
+#define VKGC_PMR 0
+#endif
+#endif
+
+#if VKGC_PMR
+#include <memory_resource>
+#endif
+
+// Call sites of depend() and release() are recorded for leak reports when this
+// is 1. They're only tracked in debug builds by default.
+#ifndef VKGC_CALL_SITES
+#ifdef NDEBUG
+#define VKGC_CALL_SITES 0
+#else
+#define VKGC_CALL_SITES 1
+#endif
+#endif
+
+// When 1, the GC can call the global Vulkan functions by default. Set this to 0
+// if they aren't available, e.g. with VK_NO_PROTOTYPES. In that case, you must
+// always pass a dispatch_table to the constructor.
+#ifndef VKGC_DEFAULT_DISPATCH
+#define VKGC_DEFAULT_DISPATCH 1
+#endif
+
+// Selects the lock that protects the GC. VKGC_LOCK_NONE is only safe if you
+// use the GC from one thread at a time.
+#define VKGC_LOCK_MUTEX 0
+#define VKGC_LOCK_SPINLOCK 1
+#define VKGC_LOCK_NONE 2
+#ifndef VKGC_LOCK_POLICY
+#define VKGC_LOCK_POLICY VKGC_LOCK_MUTEX
+#endif
+
+// Define VKGC_HEADER_ONLY to get the implementation from this header, instead
+// of compiling vkgc.cc separately.
+#ifdef VKGC_HEADER_ONLY
+#define VKGC_INLINE inline
+#else
+#define VKGC_INLINE
+#endif
+
+// When 1, the GC counts how often and for how long callers wait for its mutex.
+// This adds a little overhead to every call, so it's off by default.
+#ifndef VKGC_STATS
+#define VKGC_STATS 0
+#endif
+
+// When 1, the GC can record every call into a binary trace for offline replay,
+// see garbage_collector::start_recording().
+#ifndef VKGC_TRACING
+#define VKGC_TRACING 0
+#endif
+
+#include "vkgc_containers.hh"
+
+#if VKGC_TRACING
+#include "vkgc_trace.hh"
+#endif
 
 namespace vkgc
 {
 
+// The Vulkan functions that the GC calls. You can fill these in with
+// device-level function pointers, or use fake_device from vkgc_fake.hh to run
+// the GC without a GPU. The ones after the first four are only called if you
+// use the related features, and may be left null otherwise.
+struct dispatch_table
+{
+    PFN_vkGetSemaphoreCounterValue vkGetSemaphoreCounterValue;
+    PFN_vkDestroySemaphore vkDestroySemaphore;
+    PFN_vkWaitSemaphores vkWaitSemaphores;
+    PFN_vkDeviceWaitIdle vkDeviceWaitIdle;
+
+    // Command buffer recycling.
+    PFN_vkAllocateCommandBuffers vkAllocateCommandBuffers;
+    PFN_vkResetCommandBuffer vkResetCommandBuffer;
+    PFN_vkResetCommandPool vkResetCommandPool;
+    PFN_vkDestroyCommandPool vkDestroyCommandPool;
+
+    // Descriptor pool recycling.
+    PFN_vkResetDescriptorPool vkResetDescriptorPool;
+    PFN_vkDestroyDescriptorPool vkDestroyDescriptorPool;
+
+    // submit().
+    PFN_vkCreateSemaphore vkCreateSemaphore;
+    PFN_vkQueueSubmit2 vkQueueSubmit2;
+
+    // Fences.
+    PFN_vkCreateFence vkCreateFence;
+    PFN_vkGetFenceStatus vkGetFenceStatus;
+    PFN_vkWaitForFences vkWaitForFences;
+    PFN_vkResetFences vkResetFences;
+    PFN_vkDestroyFence vkDestroyFence;
+
+#if VKGC_DEFAULT_DISPATCH
+    // Returns the global Vulkan functions.
+    static dispatch_table global();
+#endif
+};
+
+// Test-and-test-and-set lock for short critical sections. Spins for a while,
+// then starts yielding to other threads.
+class spinlock
+{
+public:
+    void lock()
+    {
+        for(unsigned spins = 0; !try_lock(); ++spins)
+        {
+            while(locked.load(std::memory_order_relaxed))
+            {
+                if(++spins > 64)
+                    std::this_thread::yield();
+            }
+        }
+    }
+
+    bool try_lock()
+    {
+        return !locked.load(std::memory_order_relaxed) &&
+            !locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock()
+    {
+        locked.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked{false};
+};
+
+// Lock that does nothing, for single-threaded use.
+class null_lock
+{
+public:
+    void lock() {}
+    bool try_lock() { return true; }
+    void unlock() {}
+};
+
+// Location in your code that called into the GC. It's captured through default
+// arguments like std::source_location, and is an empty struct if
+// VKGC_CALL_SITES is 0.
+struct call_site
+{
+#if VKGC_CALL_SITES
+    const char* file;
+    const char* function;
+    unsigned line;
+
+    static call_site current(
+        const char* file = __builtin_FILE(),
+        const char* function = __builtin_FUNCTION(),
+        unsigned line = __builtin_LINE()
+    ){
+        call_site site;
+        site.file = file;
+        site.function = function;
+        site.line = line;
+        return site;
+    }
+#else
+    static call_site current() { return call_site(); }
+#endif
+};
+
+// Compact reference to a resource, see
+// basic_garbage_collector::register_resource(). The low 24 bits are the slot
+// of the resource in the GC, so using an id is just an array access, and the
+// high 8 bits count how many registered resources the slot has held, so that
+// the ids of destroyed resources stop working. A slot is retired instead of
+// reused when that count would wrap around, so stale ids never match again.
+struct resource_id
+{
+    resource_id(): value(UINT32_MAX) {}
+    explicit resource_id(uint32_t value): value(value) {}
+
+    bool valid() const { return value != UINT32_MAX; }
+
+    uint32_t value;
+};
+
+// Describes what keeps a resource alive, see explain().
+struct explanation
+{
+    enum reason_type
+    {
+        // The resource is not tracked by the GC. It has either already been
+        // destroyed or nothing ever depended on it.
+        NOT_TRACKED = 0,
+        // The last resource in 'chain' has not been released.
+        NOT_RELEASED,
+        // The last resource in 'chain' waits for 'timeline' to reach
+        // 'wait_value'. 'current_value' is the counter value at the time of
+        // the query.
+        TIMELINE,
+        // The last resource in 'chain' waits for 'fence' to signal.
+        FENCE,
+        // The last resource in 'chain' is already present earlier in the
+        // chain, so the resources can never be destroyed.
+        CYCLE,
+        // The last resource in 'chain' is idle in the recycling pool, see
+        // garbage_collector::release_recyclable(). It keeps using what it
+        // used until it's evicted.
+        POOLED
+    };
+    reason_type reason = NOT_TRACKED;
+
+    // Starts with the queried resource. Each following resource is a user
+    // of the previous one, e.g. image <- view <- descriptor set <- command
+    // buffer.
+    std::vector<void*> chain;
+
+    VkSemaphore timeline = VK_NULL_HANDLE;
+    uint64_t wait_value = 0;
+    uint64_t current_value = 0;
+
+    VkFence fence = VK_NULL_HANDLE;
+};
+
+// Lists resources and semaphores that look like they have been leaked.
+struct leak_report
+{
+    struct resource_entry
+    {
+        void* resource;
+        size_t dependency_count;
+        // Time since release(), zero for unreleased resources.
+        std::chrono::steady_clock::duration pending_time;
+        // Where the resource was first seen by the GC.
+        call_site depended_at;
+        call_site released_at;
+    };
+
+    struct semaphore_entry
+    {
+        VkSemaphore timeline;
+        bool released;
+        size_t pending_triggers;
+        // Smallest value that a pending trigger waits for.
+        uint64_t next_value;
+        // Time since a trigger last fired on this semaphore.
+        std::chrono::steady_clock::duration stalled_time;
+        call_site depended_at;
+        call_site released_at;
+    };
+
+    // Resources that are used by or use other resources, but haven't
+    // been released.
+    std::vector<resource_entry> unreleased;
+    // Released resources that have been waiting to be destroyed for longer
+    // than the threshold.
+    std::vector<resource_entry> stale;
+    // Semaphores with triggers that haven't fired for longer than the
+    // threshold. In the destructor's report, this lists every semaphore
+    // that the GC still knows about.
+    std::vector<semaphore_entry> semaphores;
+
+    bool empty() const;
+    void print(std::FILE* f) const;
+};
+
+// Compile-time policies of basic_garbage_collector. To change some of them,
+// derive from this and shadow the members you want to replace:
+//
+//     struct engine_traits: vkgc::default_traits
+//     {
+//         using lock_type = vkgc::null_lock;
+//         template<typename K, typename V> using map = engine::hash_map<K, V>;
+//     };
+//     using engine_gc = vkgc::basic_garbage_collector<engine_traits>;
+//
+// The map goes from handles to pool slots and needs find(), end(), emplace(),
+// erase(iterator) and size(). trigger_queue is a binary heap of small
+// entries, used through std::push_heap() and std::pop_heap(), and 'vector' is
+// its default. The default containers take their allocator from 'allocator',
+// so shadow them too if you replace it.
+//
+// The allocator passed to the constructor is converted to the allocator type
+// of each container, so all node, edge and trigger storage comes from it.
+// std::function can't take an allocator, so cleanups and callbacks that don't
+// fit in its small buffer still use the global operator new.
+struct default_traits
+{
+#if VKGC_LOCK_POLICY == VKGC_LOCK_SPINLOCK
+    using lock_type = spinlock;
+#elif VKGC_LOCK_POLICY == VKGC_LOCK_NONE
+    using lock_type = null_lock;
+#else
+    using lock_type = std::mutex;
+#endif
+
+    template<typename T>
+    using allocator = std::allocator<T>;
+
+    template<typename K, typename V>
+    using map = flat_map<K, V, allocator<std::pair<K, V>>>;
+
+    template<typename T>
+    using vector = std::vector<T, allocator<T>>;
+
+    template<typename T>
+    using trigger_queue = vector<T>;
+};
+
+#if VKGC_PMR
+// Routes all internal storage through a std::pmr::memory_resource, which you
+// pass to the constructor of basic_garbage_collector<pmr_traits>.
+struct pmr_traits: default_traits
+{
+    template<typename T>
+    using allocator = std::pmr::polymorphic_allocator<T>;
+
+    template<typename K, typename V>
+    using map = flat_map<K, V, allocator<std::pair<K, V>>>;
+
+    template<typename T>
+    using vector = std::pmr::vector<T>;
+
+    template<typename T>
+    using trigger_queue = vector<T>;
+};
+#endif
+
 // A thread-safe garbage collector for Vulkan resources. It's based on tracking
 // resource inter-dependencies, which you have to report yourself by calling the
 // depend() function (e.g. image views must depend on the image).
@@ -46,90 +380,726 @@ namespace vkgc
 // only be removed when they are not running. To achieve this, you need to use
 // the depend() overload which accepts a timeline semaphore and a value that is
 // signalled once the command buffer has finished running.
-class garbage_collector
+//
+// Null handles are never tracked. Depending on them, or on a null semaphore or
+// fence, does nothing, and so does releasing them, except that the cleanup
+// given to release(nullptr, ...) and the callbacks of triggers on null
+// semaphores and fences run right away.
+//
+// Use the garbage_collector alias unless you need to change the traits.
+template<typename Traits>
+class basic_garbage_collector
 {
 public:
-    garbage_collector(VkDevice dev);
-    garbage_collector(const garbage_collector&) = delete;
-    garbage_collector(garbage_collector&& other) noexcept = delete;
-    ~garbage_collector() = default;
+    using traits = Traits;
+    using allocator_type = typename Traits::template allocator<void*>;
+    using explanation = vkgc::explanation;
+    using leak_report = vkgc::leak_report;
+
+#if VKGC_DEFAULT_DISPATCH
+    basic_garbage_collector(
+        VkDevice dev,
+        const allocator_type& alloc = allocator_type()
+    );
+#endif
+    basic_garbage_collector(
+        VkDevice dev,
+        const dispatch_table& vk,
+        const allocator_type& alloc = allocator_type()
+    );
+    basic_garbage_collector(const basic_garbage_collector&) = delete;
+    basic_garbage_collector(basic_garbage_collector&& other) noexcept = delete;
+    // Anything still left in the GC at this point is leaked, and gets reported
+    // to the leak handler.
+    ~basic_garbage_collector();
 
     // When you do not need to refer to a resource on the CPU side anymore,
     // you must call this function to let the GC know that it can be collected
     // once no GPU resources refer to it anymore. You should call this in a
     // RAII-style destructor, e.g. destructor of a buffer class.
     // You should never add new dependencies to resources you have already
-    // released.
-    void release(void* resource, std::function<void()>&& cleanup);
+    // released. An empty 'cleanup' doesn't count as a release, so the
+    // resource is kept and reported as unreleased.
+    void release(
+        void* resource,
+        std::function<void()>&& cleanup,
+        call_site site = call_site::current()
+    );
 
     // Semaphores are a special case and need to be released with this function.
     // vkDestroySemaphore will be called once nothing waits for the semaphore
     // anymore.
-    void release(VkSemaphore sem);
+    void release(VkSemaphore sem, call_site site = call_site::current());
+
+    // Like release(), but once nothing depends on the resource anymore, it's
+    // kept in a recycling pool under 'key' instead of being cleaned up, so
+    // that acquire() can hand it back. 'key' identifies interchangeable
+    // resources, e.g. a hash of the create info and memory type. Key 0 is
+    // reserved: such a resource is cleaned up like with release() instead of
+    // being pooled, and acquire(0) always returns nullptr. 'size' counts
+    // towards the memory cap of set_recycling_limits().
+    // 'cleanup' runs once the resource is evicted from the pool.
+    //
+    // The resource keeps its dependencies on other resources (e.g. a buffer
+    // on its memory) while it's pooled and after it's acquired, so don't add
+    // them again.
+    void release_recyclable(
+        void* resource,
+        uint64_t key,
+        size_t size,
+        std::function<void()>&& cleanup,
+        call_site site = call_site::current()
+    );
+
+    // Takes the most recently pooled resource with the given key out of the
+    // recycling pool, or returns nullptr if there is none. The resource is
+    // unreleased again, so release it once you're done with it.
+    void* acquire(uint64_t key);
+
+    // Pooled resources are evicted by collect() once they have been idle for
+    // longer than 'max_age', and the oldest ones are evicted right away while
+    // the pool holds more than 'max_bytes'. wait_collect() evicts everything.
+    // The defaults are one second and no memory cap.
+    void set_recycling_limits(
+        std::chrono::steady_clock::duration max_age,
+        size_t max_bytes
+    );
+
+    // Releases a command buffer allocated from 'pool'. Once nothing depends
+    // on it anymore, it's not freed but put on the ready list of its pool,
+    // where acquire_command_buffer() picks it up again. Once you use this or
+    // acquire_command_buffer() with a pool, all of its command buffers must
+    // go through the GC.
+    void release(
+        VkCommandBuffer cmd,
+        VkCommandPool pool,
+        VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        call_site site = call_site::current()
+    );
+
+    // Returns a command buffer of 'pool' that's ready for recording. If every
+    // command buffer of the pool is back on the ready list, the whole pool is
+    // reset with one vkResetCommandPool(). Otherwise, a ready command buffer
+    // is reset with vkResetCommandBuffer() if 'pool_flags' (the flags the
+    // pool was created with) allow it, and a new one is allocated as a last
+    // resort. Returns VK_NULL_HANDLE if allocation fails.
+    //
+    // Like everything else touching the pool, this must only be called from
+    // the thread that owns the pool. collect() only moves command buffers to
+    // the ready lists and never calls Vulkan on a pool that's in use.
+    VkCommandBuffer acquire_command_buffer(
+        VkCommandPool pool,
+        VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        VkCommandPoolCreateFlags pool_flags = 0,
+        call_site site = call_site::current()
+    );
+
+    // Destroys the pool, along with all of its command buffers, once none of
+    // them are in use anymore. This isn't an overload of release(), because
+    // non-dispatchable handles can all be the same type on 32-bit platforms.
+    void release_command_pool(VkCommandPool pool, call_site site = call_site::current());
+
+    // Releases a descriptor set allocated from 'pool'. Descriptor sets are
+    // never freed individually, so the pool doesn't need
+    // VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT. Instead, the GC
+    // counts the released sets of each pool that are still depended on, and
+    // resets or destroys the whole pool once the last one is done.
+    void release(
+        VkDescriptorSet set,
+        VkDescriptorPool pool,
+        call_site site = call_site::current()
+    );
+
+    // Call this when you're done allocating from 'pool'. Once all of the sets
+    // released from it are no longer used, it's reset with a single
+    // vkResetDescriptorPool() and acquire_descriptor_pool(key) can hand it
+    // out again. Sets that weren't released through the GC are reset along
+    // with the rest, so don't keep any around. Key 0 is reserved: such a pool
+    // is destroyed like with release_descriptor_pool() instead.
+    void release_recyclable(
+        VkDescriptorPool pool,
+        uint64_t key,
+        call_site site = call_site::current()
+    );
+
+    // Returns an empty pool that was released with the same key, or
+    // VK_NULL_HANDLE if none are ready or 'key' is 0. Pools that are still idle at
+    // wait_collect() are destroyed.
+    VkDescriptorPool acquire_descriptor_pool(uint64_t key);
+
+    // Destroys the pool once the sets released from it are no longer used.
+    void release_descriptor_pool(VkDescriptorPool pool, call_site site = call_site::current());
 
-    // Checks all known semaphores and recursively destroys released resources
-    // that are no longer referenced by running command buffers or other
-    // resources. This should be called periodically, e.g. while waiting for
-    // vsync.
+    // Destroys the fence once its triggers have fired and it has signaled.
+    void release_fence(VkFence fence, call_site site = call_site::current());
+
+    // Like release_fence(), but the signaled fence is reset and kept for
+    // acquire_fence() instead. Fences are reset in batches during collect().
+    void release_recyclable(VkFence fence, call_site site = call_site::current());
+
+    // Returns an unsignaled fence, either a recycled one or a new one from
+    // vkCreateFence(). Returns VK_NULL_HANDLE if creation fails. Idle fences
+    // are destroyed by wait_collect().
+    VkFence acquire_fence();
+
+    // vkQueueSubmit2() that also signals an internal timeline semaphore of the
+    // queue with a new value after the last batch, and makes every submitted
+    // command buffer depend on it. The timeline is created on the first
+    // submit to a queue and released by wait_collect() once its last value
+    // has been reached. Like the queue itself, this must be externally
+    // synchronized. The GC's lock is held during vkQueueSubmit2(), so other
+    // threads calling into the GC wait for the submit.
+    VkResult submit(
+        VkQueue queue,
+        uint32_t submit_count,
+        const VkSubmitInfo2* submits,
+        VkFence fence = VK_NULL_HANDLE,
+        call_site site = call_site::current()
+    );
+
+    // Returns the internal timeline of the queue and the value of its latest
+    // submit(), so that other resources can depend() on it. Returns
+    // VK_NULL_HANDLE if nothing has been submitted through the GC yet.
+    VkSemaphore get_queue_timeline(VkQueue queue, uint64_t* value = nullptr);
+
+    // Checks all known semaphores and fences and recursively destroys released
+    // resources that are no longer referenced by running command buffers or
+    // other resources. This should be called periodically, e.g. while waiting
+    // for vsync.
     void collect();
 
-    // collect() but with a vkDeviceWaitIdle(). You can call this at the end of
-    // your program, right before destroying the VkDevice, to make sure that
-    // everything is properly released.
+    // collect() but waits for everything that's pending first. You can call
+    // this at the end of your program, right before destroying the VkDevice,
+    // to make sure that everything is properly released. Only the pending
+    // work is waited for: one vkWaitSemaphores() for the highest pending
+    // value of each semaphore and one vkWaitForFences(), so other queues keep
+    // running. Released fences are waited for too, so that they can be
+    // destroyed. Everything waited for must have been submitted, or this never
+    // returns; use the timeout overload if you can't be sure.
     void wait_collect();
 
+    // Blocks until 'resource' has been destroyed, waiting only for the
+    // semaphore values and fences that it and its users transitively wait
+    // for. Returns VK_SUCCESS once the cleanup has run (or if the GC doesn't
+    // know the resource), VK_TIMEOUT if the wait timed out, and VK_NOT_READY
+    // if the resource or one of its users hasn't been released, since no
+    // amount of waiting helps then. Users idle in the recycling pool are
+    // evicted. This scans the whole graph, so it's meant for
+    // occasional use like freeing memory before a big reallocation.
+    VkResult wait_destroyed(void* resource, uint64_t timeout = UINT64_MAX);
+
+    // Shutdown path for when the GPU is known to be idle, e.g. after
+    // vkDeviceWaitIdle(), or lost after VK_ERROR_DEVICE_LOST. Every semaphore
+    // and fence wait is treated as done without asking Vulkan: trigger
+    // callbacks run (in value order for each semaphore), and released
+    // resources are destroyed in one topological pass, users before used.
+    // Resources that don't depend on each other are batched by kind, so
+    // command buffers and descriptor sets only update their pools before the
+    // pools are destroyed. Internal storage is reset in bulk afterwards.
+    // Unreleased resources, and whatever they use, are left for the leak
+    // report. Recycled fences, descriptor pools and pooled resources are
+    // destroyed like in wait_collect().
+    void teardown();
+
+    // wait_collect() that gives up waiting after 'timeout' nanoseconds and
+    // returns VK_TIMEOUT, after collecting whatever did finish. Everything
+    // that's still left afterwards, like resources that were never released,
+    // is reported to 'leftovers' if given.
+    VkResult wait_collect(uint64_t timeout, leak_report* leftovers = nullptr);
+
     // The callback is called during collect() once the given timeline semaphore
     // hits the given value.
     void add_trigger(
         VkSemaphore timeline,
         uint64_t value,
-        std::function<void()>&& callback
+        std::function<void()>&& callback,
+        call_site site = call_site::current()
     );
 
     // Marks a dependency between two resources, where 'user_resource'
     // must be deleted before 'used_resource'.
-    void depend(void* used_resource, void* user_resource);
+    void depend(
+        void* used_resource,
+        void* user_resource,
+        call_site site = call_site::current()
+    );
 
     // Faster version of depend() for depending on many things simultaneously,
     // e.g. descriptor set depending on a pile of textures.
-    void depend_many(void** used_resources, size_t used_resource_count, void* user_resource);
+    void depend_many(
+        void** used_resources,
+        size_t used_resource_count,
+        void* user_resource,
+        call_site site = call_site::current()
+    );
+
+    // Starts tracking the resource if it isn't tracked yet, and returns an id
+    // for it. The resource_id overloads of depend(), depend_many() and
+    // release() find the resource by indexing instead of hashing the handle,
+    // so register resources that get many dependencies, like textures, once
+    // and keep the id around. The id stops working once the resource has
+    // been destroyed, and calls with such ids are ignored. Every 256th
+    // registered resource destroyed in a slot retires the slot for good, so
+    // churning through ids costs well under a byte per id. Returns an invalid
+    // id if the GC tracks more than 16M resources, and then only keeps
+    // tracking the resource if it already did.
+    resource_id register_resource(void* resource, call_site site = call_site::current());
+
+    void depend(
+        resource_id used_resource,
+        resource_id user_resource,
+        call_site site = call_site::current()
+    );
+
+    void depend_many(
+        const resource_id* used_resources,
+        size_t used_resource_count,
+        resource_id user_resource,
+        call_site site = call_site::current()
+    );
+
+    void depend(
+        resource_id used_resource,
+        VkSemaphore timeline,
+        uint64_t value,
+        call_site site = call_site::current()
+    );
+
+    void depend_many(
+        const resource_id* used_resources,
+        size_t used_resource_count,
+        VkSemaphore timeline,
+        uint64_t value,
+        call_site site = call_site::current()
+    );
+
+    void depend(
+        resource_id used_resource,
+        VkFence fence,
+        call_site site = call_site::current()
+    );
+
+    void release(
+        resource_id resource,
+        std::function<void()>&& cleanup,
+        call_site site = call_site::current()
+    );
 
     // Makes sure that used_resource is not deleted before the given timeline
     // semaphore hits 'value'. Typically, used_resource would be a
-    // VkCommandBuffer here.
-    void depend(void* used_resource, VkSemaphore timeline, uint64_t value);
+    // VkCommandBuffer here. If collect() has already seen the semaphore reach
+    // 'value', this does nothing.
+    void depend(
+        void* used_resource,
+        VkSemaphore timeline,
+        uint64_t value,
+        call_site site = call_site::current()
+    );
+
+    // depend() for many resources that wait for the same value, e.g. all
+    // command buffers and staging buffers of a submit. They share a single
+    // trigger, so this costs one heap operation instead of one per resource.
+    // Like depend(), this does nothing if the value is known to be reached.
+    void depend_many(
+        void** used_resources,
+        size_t used_resource_count,
+        VkSemaphore timeline,
+        uint64_t value,
+        call_site site = call_site::current()
+    );
+
+    // Makes sure that used_resource is not deleted before the fence signals.
+    // Prefer timeline semaphores where you can: fences can't be waited for
+    // past their first signal, so each one needs its own status check.
+    void depend(
+        void* used_resource,
+        VkFence fence,
+        call_site site = call_site::current()
+    );
+
+    // The callback is called during collect() once the fence has signaled.
+    void add_trigger(
+        VkFence fence,
+        std::function<void()>&& callback,
+        call_site site = call_site::current()
+    );
+
+    // Returns the counter value of the semaphore as of the latest collect(),
+    // without calling Vulkan. Returns 0 for semaphores the GC doesn't track.
+    uint64_t query_value(VkSemaphore timeline);
+
+    // Finds the chain of users that keeps 'resource' from being destroyed.
+    // Unreleased users are reported over timeline and fence waits even if
+    // they are further away, because waits resolve by themselves and
+    // forgotten release() calls don't. This walks the whole dependency graph,
+    // so it's only meant for debugging.
+    explanation explain(void* resource);
+
+    // Returns the allocator given to the constructor.
+    allocator_type get_allocator() const;
+
+    // Builds a leak report on demand. 'stale_threshold' is how long released
+    // resources and triggers may stay pending before they are reported.
+    leak_report report(std::chrono::steady_clock::duration stale_threshold);
+
+    // Sets the function that receives the report of everything still left in
+    // the GC when it's destroyed. Without a handler, non-empty reports are
+    // printed to stderr in debug builds.
+    void set_leak_handler(std::function<void(const leak_report&)>&& handler);
+
+#if VKGC_TRACING
+    // Records every call that changes what the GC tracks into a compact
+    // binary trace at 'path' until stop_recording() or destruction.
+    // tools/vkgc_replay.cc replays these against the fake device. Returns
+    // false if the file can't be opened.
+    bool start_recording(const char* path);
+    void stop_recording();
+#endif
+
+#if VKGC_STATS
+    struct statistics
+    {
+        uint64_t lock_acquisitions;
+        // Acquisitions where another thread was holding the mutex.
+        uint64_t lock_contentions;
+        // Total time spent waiting for the mutex in contended acquisitions.
+        uint64_t lock_wait_ns;
+    };
+
+    statistics get_statistics();
+    void reset_statistics();
+#endif
 
 private:
-    void check_delete(void* resource);
+    using lock_type = typename Traits::lock_type;
+    template<typename K, typename V>
+    using map = typename Traits::template map<K, V>;
+    template<typename T>
+    using vector = typename Traits::template vector<T>;
+    template<typename T, uint32_t ChunkSize = 256>
+    using pool = slot_pool<T, allocator_type, ChunkSize>;
+    static const uint32_t none = UINT32_MAX;
+
+    std::unique_lock<lock_type> lock();
+    void check_delete(uint32_t slot);
+    leak_report build_report(
+        std::chrono::steady_clock::duration stale_threshold,
+        bool final_report
+    );
 
-    std::mutex mutex;
+    lock_type mutex;
+#if VKGC_STATS
+    statistics stats = {};
+#endif
     VkDevice dev;
+    dispatch_table vk;
+    allocator_type alloc;
+
+    // The node slots of the resources used by one user, in a linked list of
+    // cache line sized blocks.
+    struct edge_block
+    {
+        static const uint32_t capacity = 13;
+        uint32_t used[capacity];
+        uint32_t count;
+        uint32_t next;
+        uint32_t next_free;
+    };
+
+    // What happens to a resource once nothing depends on it anymore.
+    enum node_kind: uint8_t
+    {
+        // Runs 'cleanup'.
+        NODE_CLEANUP = 0,
+        // Goes to the recycling pool, 'owner' is its recycle_info.
+        NODE_RECYCLABLE,
+        // Goes to the ready list of the command_pool_info in 'owner'.
+        NODE_COMMAND_BUFFER,
+        // Counts down the descriptor_pool_info in 'owner'.
+        NODE_DESCRIPTOR_SET
+    };
+
+    // The part of a node that cascades check for every edge. These live in
+    // a dense array indexed by node slot, so that counting down a node that
+    // isn't ready yet touches 8 bytes instead of the cache lines holding its
+    // cleanup and call sites.
+    struct node_state
+    {
+        uint32_t dependency_count = 0;
+        node_kind kind = NODE_CLEANUP;
+        bool released = false;
+        // Bumped whenever the slot is freed after handing out an id, see
+        // resource_id.
+        uint8_t generation = 0;
+    };
 
     struct dependency_info
     {
-        size_t dependency_count = 0;
-        std::vector<void* /*resource*/> dependents;
+        // nullptr while the slot is free.
+        void* resource = nullptr;
+        // First edge_block, or none.
+        uint32_t edges = none;
+        uint32_t owner = none;
+        uint32_t next_free = none;
+        // For NODE_COMMAND_BUFFER.
+        bool secondary = false;
+        // Set by register_resource().
+        bool has_id = false;
+        // Set once 'generation' has wrapped around, the slot is never reused.
+        bool retired = false;
         std::function<void()> cleanup;
+        std::chrono::steady_clock::time_point release_time;
+#if VKGC_CALL_SITES
+        call_site depended_at;
+        call_site released_at;
+#endif
     };
 
-    std::unordered_map<void* /*resource*/, dependency_info> resources;
+    static const uint32_t id_slot_bits = 24;
 
+    // Slot of the node of 'resource', which is created if needed.
+    uint32_t get_slot(void* resource, const call_site& site);
+    // Slot of the node 'id' refers to, or none if it's stale.
+    uint32_t get_slot(resource_id id);
+    // Edge lists are chains of edge_blocks starting from 'head'. Besides the
+    // edges of nodes, they hold the nodes of group triggers.
+    void add_edge(uint32_t& head, uint32_t used_slot);
+    void add_dependency(uint32_t used_slot, uint32_t user_slot);
+    void release_node(uint32_t slot, std::function<void()>&& cleanup, const call_site& site);
+    void free_edges(uint32_t head);
+    void destroy(uint32_t slot);
+    void free_node(uint32_t slot);
+    // Starts a new generation of the slot, returns false if it's retired.
+    bool next_generation(uint32_t slot);
+    template<typename F>
+    void for_each_edge(uint32_t head, F&& f);
+
+    // Nodes live in a pool and are recycled when their resource is
+    // destroyed, so steady-state operation doesn't allocate. 'node_states'
+    // grows along with 'nodes' and is indexed by the same slots.
+    pool<dependency_info> nodes;
+    vector<node_state> node_states;
+    pool<edge_block> edge_blocks;
+    map<void* /*resource*/, uint32_t /*slot*/> resources;
+    // Nodes that check_delete() found ready, destroyed by its outermost call
+    // so that long dependency chains don't recurse.
+    vector<uint32_t> cascade;
+    bool cascading = false;
+
+    // Heap entries only refer to the payload in trigger_info, so heap
+    // operations move 16 bytes instead of a whole std::function.
     struct trigger
     {
         uint64_t value;
-        void* dependent;
-        std::function<void()> callback;
+        uint32_t slot;
         bool operator<(const trigger& t) const;
     };
 
+    struct trigger_info
+    {
+        // Node slot, or none.
+        uint32_t dependent = none;
+        // Edge list of further dependents from depend_many(), or none.
+        uint32_t group = none;
+        std::function<void()> callback;
+        uint32_t next_free = none;
+    };
+    pool<trigger_info> trigger_infos;
+
     struct semaphore_info
     {
-        std::priority_queue<trigger> triggers;
+        explicit semaphore_info(const allocator_type& alloc): triggers(alloc) {}
+
+        // VK_NULL_HANDLE while the slot is free.
+        VkSemaphore handle = VK_NULL_HANDLE;
+        // Binary heap ordered by trigger::operator<, so the smallest value is
+        // at the front. It keeps its capacity when the slot is recycled.
+        typename Traits::template trigger_queue<trigger> triggers;
         bool should_destroy = false;
+        // Counter value seen by the latest collect(). Timelines only go up,
+        // so waits for this value or below are already over.
+        uint64_t last_value = 0;
+        // Last time a trigger fired or was added to an empty heap.
+        std::chrono::steady_clock::time_point last_progress;
+        uint32_t next_free = none;
+#if VKGC_CALL_SITES
+        call_site depended_at;
+        call_site released_at;
+#endif
+    };
+    pool<semaphore_info, 16> semaphore_infos;
+    map<VkSemaphore, uint32_t /*slot*/> semaphore_dependencies;
+
+    semaphore_info& get_semaphore(VkSemaphore sem, const call_site& site);
+    bool reached(VkSemaphore timeline, uint64_t value);
+    void push_trigger(
+        semaphore_info& sem,
+        uint64_t value,
+        uint32_t dependent,
+        std::function<void()>&& callback,
+        uint32_t group = none
+    );
+    void fire_trigger(uint32_t slot);
+
+    enum fence_state: uint8_t
+    {
+        FENCE_IN_USE = 0,
+        FENCE_DESTROY,
+        FENCE_RECYCLE
     };
-    std::unordered_map<VkSemaphore, semaphore_info> semaphore_dependencies;
+
+    // Fences aren't ordered like timeline values, so a fence just has a list
+    // of trigger_info slots that all fire at once.
+    struct fence_info
+    {
+        explicit fence_info(const allocator_type& alloc): triggers(alloc) {}
+
+        // VK_NULL_HANDLE while the slot is free.
+        VkFence handle = VK_NULL_HANDLE;
+        fence_state state = FENCE_IN_USE;
+        vector<uint32_t> triggers;
+        uint32_t next_free = none;
+    };
+    pool<fence_info, 16> fence_infos;
+    map<VkFence, uint32_t /*slot*/> fence_dependencies;
+    // Reset and ready for acquire_fence().
+    vector<VkFence> idle_fences;
+    // Scratch space for batched fence and semaphore calls.
+    vector<VkFence> fence_batch;
+    vector<VkSemaphore> wait_semaphores;
+    vector<uint64_t> wait_values;
+    vector<VkFence> fence_resets;
+
+    uint32_t get_fence(VkFence fence);
+    void poll_fences();
+    // Waits for 'wait_values' of 'wait_semaphores' and then 'fence_batch'.
+    VkResult wait_pending(uint64_t timeout);
+    void finish_fence(uint32_t slot);
+    // Marks the internal timelines of all queues for destruction.
+    void release_queues();
+
+    struct queue_info
+    {
+        explicit queue_info(const allocator_type& alloc)
+        : submits(alloc), signals(alloc) {}
+
+        // VK_NULL_HANDLE while the slot is free.
+        VkQueue queue = VK_NULL_HANDLE;
+        VkSemaphore timeline = VK_NULL_HANDLE;
+        // Last value submit() has signaled.
+        uint64_t value = 0;
+        // Copies of the submitted batches with the extra signal operation.
+        vector<VkSubmitInfo2> submits;
+        vector<VkSemaphoreSubmitInfo> signals;
+        uint32_t next_free = none;
+    };
+    pool<queue_info, 16> queue_infos;
+    map<VkQueue, uint32_t /*slot*/> queues;
+
+    // Bookkeeping of a recyclable resource. While it's pooled, it's in the
+    // list of its key, newest first, and in the pool-wide LRU list.
+    struct recycle_info
+    {
+        uint64_t key;
+        size_t size;
+        uint32_t node;
+        bool pooled = false;
+        std::chrono::steady_clock::time_point pooled_time;
+        uint32_t key_prev;
+        uint32_t key_next;
+        uint32_t newer;
+        uint32_t older;
+        uint32_t next_free = none;
+    };
+    pool<recycle_info> recycle_infos;
+    // Newest pooled recycle_info of each key.
+    map<uint64_t /*key*/, uint32_t /*slot*/> recycle_keys;
+    uint32_t newest_pooled = none;
+    uint32_t oldest_pooled = none;
+    size_t pooled_bytes = 0;
+    std::chrono::steady_clock::duration recycle_max_age = std::chrono::seconds(1);
+    size_t recycle_max_bytes = SIZE_MAX;
+
+    void pool_resource(uint32_t node_slot);
+    void unpool(uint32_t slot);
+    void evict(uint32_t slot);
+
+    // Command buffers go to 'ready' when they're done, and to 'clean' once
+    // they've been reset. Both are indexed by the level.
+    struct command_pool_info
+    {
+        explicit command_pool_info(const allocator_type& alloc)
+        : ready{vector<VkCommandBuffer>(alloc), vector<VkCommandBuffer>(alloc)},
+          clean{vector<VkCommandBuffer>(alloc), vector<VkCommandBuffer>(alloc)} {}
+
+        // VK_NULL_HANDLE while the slot is free.
+        VkCommandPool pool = VK_NULL_HANDLE;
+        bool should_destroy = false;
+        // Handed out by acquire_command_buffer() and not released yet.
+        uint32_t recording = 0;
+        // Released, but still depended on.
+        uint32_t pending = 0;
+        vector<VkCommandBuffer> ready[2];
+        vector<VkCommandBuffer> clean[2];
+        uint32_t next_free = none;
+    };
+    pool<command_pool_info, 16> command_pool_infos;
+    map<VkCommandPool, uint32_t /*slot*/> command_pools;
+
+    uint32_t get_command_pool(VkCommandPool pool);
+    void check_destroy_command_pool(uint32_t slot);
+
+    enum descriptor_pool_state: uint8_t
+    {
+        // Sets are still being allocated from it.
+        POOL_IN_USE = 0,
+        // Reset when 'pending' reaches zero.
+        POOL_RECYCLE,
+        // Destroyed when 'pending' reaches zero.
+        POOL_DESTROY,
+        // Reset and waiting for acquire_descriptor_pool().
+        POOL_IDLE
+    };
+
+    struct descriptor_pool_info
+    {
+        // VK_NULL_HANDLE while the slot is free.
+        VkDescriptorPool pool = VK_NULL_HANDLE;
+        descriptor_pool_state state = POOL_IN_USE;
+        // Released sets that are still depended on.
+        uint32_t pending = 0;
+        uint64_t key = 0;
+        // Next idle pool with the same key, or none.
+        uint32_t next_idle = none;
+        uint32_t next_free = none;
+    };
+    pool<descriptor_pool_info, 16> descriptor_pool_infos;
+    map<VkDescriptorPool, uint32_t /*slot*/> descriptor_pools;
+    // First idle pool for each key.
+    map<uint64_t, uint32_t /*slot*/> idle_descriptor_pools;
+
+    uint32_t get_descriptor_pool(VkDescriptorPool pool);
+    void check_descriptor_pool(uint32_t slot);
+    void destroy_descriptor_pool(uint32_t slot);
+
+    std::function<void(const leak_report&)> leak_handler;
+
+#if VKGC_TRACING
+    std::unique_ptr<trace_writer> recorder;
+#endif
 };
 
+using garbage_collector = basic_garbage_collector<default_traits>;
+
 }
 
+#include "vkgc_impl.hh"
+
+#ifdef VKGC_HEADER_ONLY
+#include "vkgc.cc"
+#if VKGC_TRACING
+#include "vkgc_trace.cc"
+#endif
+#endif
+
 #endif
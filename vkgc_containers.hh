@@ -0,0 +1,265 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+// Storage used by basic_garbage_collector. After warm-up, none of these
+// allocate: the map only grows, and pools hand out recycled objects.
+#ifndef VKGC_CONTAINERS_HH
+#define VKGC_CONTAINERS_HH
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vkgc
+{
+
+// Open-addressing hash map with linear probing, meant for handle keys. The
+// default-constructed key (VK_NULL_HANDLE, nullptr, 0) marks empty slots, so
+// it can't be inserted and is never found. Entries move on insertion and
+// erasure, so iterators are only valid until the next change.
+template<typename K, typename V, typename Alloc = std::allocator<std::pair<K, V>>>
+class flat_map
+{
+    static_assert(
+        std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+        "flat_map only holds handles and indices"
+    );
+public:
+    using value_type = std::pair<K, V>;
+    using iterator = value_type*;
+    using allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<value_type>;
+
+    explicit flat_map(const Alloc& alloc = Alloc())
+    : alloc(alloc), slots(nullptr), capacity(0), count(0) {}
+
+    flat_map(const flat_map&) = delete;
+    flat_map& operator=(const flat_map&) = delete;
+
+    ~flat_map()
+    {
+        if(slots)
+            std::allocator_traits<allocator_type>::deallocate(alloc, slots, capacity);
+    }
+
+    // Returns end() if the key isn't present.
+    iterator find(const K& key)
+    {
+        if(count == 0 || key == K())
+            return end();
+        for(size_t i = home(key);; i = (i + 1) & (capacity - 1))
+        {
+            if(slots[i].first == key)
+                return slots + i;
+            if(slots[i].first == K())
+                return end();
+        }
+    }
+
+    iterator end() { return nullptr; }
+
+    // Returns {end(), false} for the empty-slot key.
+    std::pair<iterator, bool> emplace(const K& key, const V& value)
+    {
+        if(key == K())
+            return {end(), false};
+        if((count + 1) * 2 > capacity)
+            grow();
+        size_t i = home(key);
+        for(; slots[i].first != K(); i = (i + 1) & (capacity - 1))
+        {
+            if(slots[i].first == key)
+                return {slots + i, false};
+        }
+        slots[i].first = key;
+        slots[i].second = value;
+        count++;
+        return {slots + i, true};
+    }
+
+    // Backward-shift deletion, so no tombstones pile up in steady state.
+    // Erasing end() does nothing.
+    void erase(iterator it)
+    {
+        if(it == end())
+            return;
+        size_t hole = it - slots;
+        for(size_t i = (hole + 1) & (capacity - 1);; i = (i + 1) & (capacity - 1))
+        {
+            if(slots[i].first == K())
+                break;
+            // Entries whose home is cyclically in (hole, i] must stay put.
+            size_t h = home(slots[i].first);
+            bool stays = hole < i ? (hole < h && h <= i) : (hole < h || h <= i);
+            if(!stays)
+            {
+                slots[hole] = slots[i];
+                hole = i;
+            }
+        }
+        slots[hole].first = K();
+        count--;
+    }
+
+    size_t size() const { return count; }
+
+    // Keeps the storage.
+    void clear()
+    {
+        for(size_t i = 0; i < capacity; ++i)
+            slots[i].first = K();
+        count = 0;
+    }
+
+private:
+    template<typename T>
+    static uint64_t bits(T* p) { return (uintptr_t)p; }
+    static uint64_t bits(uint64_t v) { return v; }
+
+    size_t home(const K& key) const
+    {
+        // Fibonacci hashing, handles tend to be aligned and sequential.
+        return (size_t)((bits(key) * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    void grow()
+    {
+        value_type* old_slots = slots;
+        size_t old_capacity = capacity;
+        capacity = capacity ? capacity * 2 : 16;
+        shift = 64;
+        for(size_t c = capacity; c > 1; c >>= 1)
+            shift--;
+
+        slots = std::allocator_traits<allocator_type>::allocate(alloc, capacity);
+        for(size_t i = 0; i < capacity; ++i)
+            new (slots + i) value_type();
+        count = 0;
+        for(size_t i = 0; i < old_capacity; ++i)
+        {
+            if(old_slots[i].first != K())
+                emplace(old_slots[i].first, old_slots[i].second);
+        }
+        if(old_slots)
+            std::allocator_traits<allocator_type>::deallocate(alloc, old_slots, old_capacity);
+    }
+
+    allocator_type alloc;
+    value_type* slots;
+    size_t capacity;
+    size_t count;
+    unsigned shift = 64;
+};
+
+// Objects in fixed-size chunks that never move once allocated, so slot
+// indices and references stay valid. Released slots go to an intrusive free
+// list threaded through T::next_free and are handed out again without
+// destroying the object, so T can keep its internal storage around.
+template<typename T, typename Alloc, uint32_t ChunkSize = 256>
+class slot_pool
+{
+public:
+    static const uint32_t none = UINT32_MAX;
+
+    explicit slot_pool(const Alloc& alloc)
+    : alloc(alloc), chunks(alloc), used(0), free_head(none) {}
+
+    slot_pool(const slot_pool&) = delete;
+    slot_pool& operator=(const slot_pool&) = delete;
+
+    ~slot_pool()
+    {
+        for(uint32_t i = 0; i < used; ++i)
+            std::allocator_traits<allocator_type>::destroy(alloc, &(*this)[i]);
+        for(T* chunk: chunks)
+            std::allocator_traits<allocator_type>::deallocate(alloc, chunk, ChunkSize);
+    }
+
+    T& operator[](uint32_t slot)
+    {
+        return chunks[slot / ChunkSize][slot % ChunkSize];
+    }
+
+    // 'args' are only used to construct the object if the slot has never been
+    // handed out before; recycled objects are returned as they were released.
+    template<typename... Args>
+    uint32_t acquire(Args&&... args)
+    {
+        if(free_head != none)
+        {
+            uint32_t slot = free_head;
+            free_head = (*this)[slot].next_free;
+            return slot;
+        }
+        if(used == chunks.size() * ChunkSize)
+            chunks.push_back(std::allocator_traits<allocator_type>::allocate(alloc, ChunkSize));
+        std::allocator_traits<allocator_type>::construct(
+            alloc, &chunks.back()[used % ChunkSize], std::forward<Args>(args)...
+        );
+        return used++;
+    }
+
+    void release(uint32_t slot)
+    {
+        (*this)[slot].next_free = free_head;
+        free_head = slot;
+    }
+
+    // Rebuilds the free list from the slots for which is_free(slot) is true,
+    // lowest first, to release many slots at once. Like release(), this
+    // keeps the objects as they are, so reset them first.
+    template<typename F>
+    void reclaim(F&& is_free)
+    {
+        free_head = none;
+        for(uint32_t slot = used; slot-- > 0;)
+            if(is_free(slot))
+                release(slot);
+    }
+
+    void clear()
+    {
+        reclaim([](uint32_t){ return true; });
+    }
+
+    // Number of slots that have been handed out at least once. Iterating up
+    // to this visits free slots too, so T needs to tell them apart itself.
+    uint32_t size() const { return used; }
+
+private:
+    using allocator_type = typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+    using chunk_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<T*>;
+
+    allocator_type alloc;
+    std::vector<T*, chunk_allocator> chunks;
+    uint32_t used;
+    uint32_t free_head;
+};
+
+}
+
+#endif
@@ -0,0 +1,634 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+#include "vkgc_fake.hh"
+#include <algorithm>
+
+namespace vkgc
+{
+
+namespace
+{
+
+template<typename T>
+uint64_t handle_to_id(T handle)
+{
+    return (uint64_t)(uintptr_t)handle;
+}
+
+template<typename T = VkSemaphore>
+T id_to_handle(uint64_t id)
+{
+    return (T)(uintptr_t)id;
+}
+
+}
+
+fake_device::fake_device()
+: handle_counter(0), submitted_command_buffers(0), errors(0)
+{
+    for(unsigned i = 0; i < ENTRY_POINT_COUNT; ++i)
+    {
+        latency_ns[i] = 0;
+        calls[i] = 0;
+    }
+}
+
+fake_device::~fake_device()
+{
+}
+
+VkDevice fake_device::device()
+{
+    return reinterpret_cast<VkDevice>(this);
+}
+
+dispatch_table fake_device::dispatch() const
+{
+    dispatch_table vk;
+    vk.vkGetSemaphoreCounterValue = get_semaphore_counter_value;
+    vk.vkDestroySemaphore = destroy_semaphore;
+    vk.vkWaitSemaphores = wait_semaphores;
+    vk.vkDeviceWaitIdle = device_wait_idle;
+    vk.vkAllocateCommandBuffers = allocate_command_buffers;
+    vk.vkResetCommandBuffer = reset_command_buffer;
+    vk.vkResetCommandPool = reset_command_pool;
+    vk.vkDestroyCommandPool = destroy_command_pool;
+    vk.vkResetDescriptorPool = reset_descriptor_pool;
+    vk.vkDestroyDescriptorPool = destroy_descriptor_pool;
+    vk.vkCreateSemaphore = create_semaphore;
+    vk.vkQueueSubmit2 = queue_submit2;
+    vk.vkCreateFence = create_fence;
+    vk.vkGetFenceStatus = get_fence_status;
+    vk.vkWaitForFences = wait_for_fences;
+    vk.vkResetFences = reset_fences;
+    vk.vkDestroyFence = destroy_fence;
+    return vk;
+}
+
+VkSemaphore fake_device::create_timeline(uint64_t initial_value)
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    // Handles are spaced out so that they look like pointers, and never null.
+    uint64_t id = ++handle_counter * 16;
+    timelines[id] = {initial_value, initial_value};
+    return id_to_handle(id);
+}
+
+void fake_device::signal(VkSemaphore sem, uint64_t value)
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    timeline* t = find(sem);
+    if(!t) return;
+    t->value = value;
+    t->submitted = std::max(t->submitted, value);
+    signaled.notify_all();
+}
+
+void fake_device::submit(VkSemaphore sem, uint64_t value)
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    timeline* t = find(sem);
+    if(!t) return;
+    t->submitted = std::max(t->submitted, value);
+}
+
+void fake_device::finish()
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    for(auto& pair: timelines)
+        pair.second.value = pair.second.submitted;
+    for(auto& pair: fences)
+        pair.second.value = pair.second.submitted;
+    signaled.notify_all();
+}
+
+uint64_t fake_device::value(VkSemaphore sem) const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    auto it = timelines.find(handle_to_id(sem));
+    return it == timelines.end() ? 0 : it->second.value;
+}
+
+bool fake_device::alive(VkSemaphore sem) const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    return timelines.count(handle_to_id(sem)) != 0;
+}
+
+size_t fake_device::alive_semaphore_count() const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    return timelines.size();
+}
+
+VkQueue fake_device::queue(uint32_t index)
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    while(queues.size() <= index)
+        queues.emplace_back(new submit_queue{this});
+    return reinterpret_cast<VkQueue>(queues[index].get());
+}
+
+uint64_t fake_device::submitted_command_buffer_count() const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    return submitted_command_buffers;
+}
+
+VkFence fake_device::create_fence(bool signaled)
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    uint64_t id = ++handle_counter * 16;
+    fences[id] = {signaled ? 1u : 0u, signaled ? 1u : 0u};
+    return id_to_handle<VkFence>(id);
+}
+
+void fake_device::signal(VkFence fence)
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    timeline* t = find(fence);
+    if(!t) return;
+    t->value = t->submitted = 1;
+    signaled.notify_all();
+}
+
+void fake_device::submit(VkFence fence)
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    timeline* t = find(fence);
+    if(!t) return;
+    t->submitted = 1;
+}
+
+bool fake_device::fence_signaled(VkFence fence) const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    auto it = fences.find(handle_to_id(fence));
+    return it != fences.end() && it->second.value != 0;
+}
+
+bool fake_device::alive_fence(VkFence fence) const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    return fences.count(handle_to_id(fence)) != 0;
+}
+
+size_t fake_device::alive_fence_count() const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    return fences.size();
+}
+
+VkCommandPool fake_device::create_command_pool()
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    uint64_t id = ++handle_counter * 16;
+    command_pools[id];
+    return id_to_handle<VkCommandPool>(id);
+}
+
+bool fake_device::alive_command_pool(VkCommandPool pool) const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    return command_pools.count(handle_to_id(pool)) != 0;
+}
+
+size_t fake_device::command_buffer_count(VkCommandPool pool) const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    auto it = command_pools.find(handle_to_id(pool));
+    return it == command_pools.end() ? 0 : it->second.size();
+}
+
+VkCommandBuffer fake_device::allocate_command_buffer(VkCommandPool pool)
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    auto* buffers = find(pool);
+    if(!buffers) return VK_NULL_HANDLE;
+    command_buffer* cmd = new command_buffer{this, handle_to_id(pool), 0};
+    buffers->emplace_back(cmd);
+    return reinterpret_cast<VkCommandBuffer>(cmd);
+}
+
+uint64_t fake_device::reset_count(VkCommandBuffer cmd) const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    return reinterpret_cast<const command_buffer*>(cmd)->resets;
+}
+
+VkDescriptorPool fake_device::create_descriptor_pool()
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    uint64_t id = ++handle_counter * 16;
+    descriptor_pools[id] = 0;
+    return id_to_handle<VkDescriptorPool>(id);
+}
+
+bool fake_device::alive_descriptor_pool(VkDescriptorPool pool) const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    return descriptor_pools.count(handle_to_id(pool)) != 0;
+}
+
+uint64_t fake_device::reset_count(VkDescriptorPool pool) const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    auto it = descriptor_pools.find(handle_to_id(pool));
+    return it == descriptor_pools.end() ? 0 : it->second;
+}
+
+void fake_device::set_latency(entry_point func, std::chrono::nanoseconds latency)
+{
+    latency_ns[func] = latency.count();
+}
+
+uint64_t fake_device::call_count(entry_point func) const
+{
+    return calls[func];
+}
+
+uint64_t fake_device::error_count() const
+{
+    return errors;
+}
+
+std::vector<fake_device::call> fake_device::destroy_log() const
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    return log;
+}
+
+void fake_device::clear_log()
+{
+    std::unique_lock<std::mutex> lk(mutex);
+    log.clear();
+}
+
+void fake_device::begin_call(entry_point func)
+{
+    calls[func]++;
+    uint64_t latency = latency_ns[func];
+    if(latency == 0)
+        return;
+
+    // Spin instead of sleeping, sleeps are far too coarse for emulating
+    // driver overhead.
+    auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(latency);
+    while(std::chrono::steady_clock::now() < end);
+}
+
+fake_device::timeline* fake_device::find(VkSemaphore sem)
+{
+    auto it = timelines.find(handle_to_id(sem));
+    if(it == timelines.end())
+    {
+        errors++;
+        return nullptr;
+    }
+    return &it->second;
+}
+
+std::vector<std::unique_ptr<fake_device::command_buffer>>* fake_device::find(
+    VkCommandPool pool
+){
+    auto it = command_pools.find(handle_to_id(pool));
+    if(it == command_pools.end())
+    {
+        errors++;
+        return nullptr;
+    }
+    return &it->second;
+}
+
+fake_device::timeline* fake_device::find(VkFence fence)
+{
+    auto it = fences.find(handle_to_id(fence));
+    if(it == fences.end())
+    {
+        errors++;
+        return nullptr;
+    }
+    return &it->second;
+}
+
+fake_device* fake_device::from(VkDevice dev)
+{
+    return reinterpret_cast<fake_device*>(dev);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::get_semaphore_counter_value(
+    VkDevice dev, VkSemaphore sem, uint64_t* value
+){
+    fake_device* self = from(dev);
+    self->begin_call(GET_SEMAPHORE_COUNTER_VALUE);
+    std::unique_lock<std::mutex> lk(self->mutex);
+    timeline* t = self->find(sem);
+    if(!t) return VK_ERROR_DEVICE_LOST;
+    *value = t->value;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL fake_device::destroy_semaphore(
+    VkDevice dev, VkSemaphore sem, const VkAllocationCallbacks*
+){
+    fake_device* self = from(dev);
+    self->begin_call(DESTROY_SEMAPHORE);
+    if(sem == VK_NULL_HANDLE)
+        return;
+
+    std::unique_lock<std::mutex> lk(self->mutex);
+    timeline* t = self->find(sem);
+    if(t)
+    {
+        // The GPU would still signal it.
+        if(t->submitted > t->value)
+            self->errors++;
+        self->timelines.erase(handle_to_id(sem));
+    }
+    self->log.push_back({DESTROY_SEMAPHORE, handle_to_id(sem)});
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::wait_semaphores(
+    VkDevice dev, const VkSemaphoreWaitInfo* info, uint64_t timeout
+){
+    fake_device* self = from(dev);
+    self->begin_call(WAIT_SEMAPHORES);
+    bool wait_any = info->flags & 1 /*VK_SEMAPHORE_WAIT_ANY_BIT*/;
+
+    std::unique_lock<std::mutex> lk(self->mutex);
+    // Waiting lets the "GPU" run submitted work up to the awaited values.
+    for(uint32_t i = 0; i < info->semaphoreCount; ++i)
+    {
+        timeline* t = self->find(info->pSemaphores[i]);
+        if(!t) return VK_ERROR_DEVICE_LOST;
+        if(t->value < info->pValues[i] && t->submitted >= info->pValues[i])
+            t->value = info->pValues[i];
+    }
+
+    auto done = [&]() {
+        uint32_t reached = 0;
+        for(uint32_t i = 0; i < info->semaphoreCount; ++i)
+        {
+            timeline* t = self->find(info->pSemaphores[i]);
+            if(t && t->value >= info->pValues[i])
+                reached++;
+        }
+        return wait_any ? reached != 0 : reached == info->semaphoreCount;
+    };
+
+    // The rest can only be reached if the host signals them.
+    if(timeout == UINT64_MAX)
+        self->signaled.wait(lk, done);
+    else if(!self->signaled.wait_for(lk, std::chrono::nanoseconds(timeout), done))
+        return VK_TIMEOUT;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::device_wait_idle(VkDevice dev)
+{
+    fake_device* self = from(dev);
+    self->begin_call(DEVICE_WAIT_IDLE);
+    self->finish();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::allocate_command_buffers(
+    VkDevice dev, const VkCommandBufferAllocateInfo* info, VkCommandBuffer* cmds
+){
+    fake_device* self = from(dev);
+    self->begin_call(ALLOCATE_COMMAND_BUFFERS);
+    std::unique_lock<std::mutex> lk(self->mutex);
+    auto* buffers = self->find(info->commandPool);
+    if(!buffers) return VK_ERROR_DEVICE_LOST;
+    for(uint32_t i = 0; i < info->commandBufferCount; ++i)
+    {
+        command_buffer* cmd = new command_buffer{
+            self, handle_to_id(info->commandPool), 0
+        };
+        buffers->emplace_back(cmd);
+        cmds[i] = reinterpret_cast<VkCommandBuffer>(cmd);
+    }
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::reset_command_buffer(
+    VkCommandBuffer cmd, VkCommandBufferResetFlags
+){
+    command_buffer* buf = reinterpret_cast<command_buffer*>(cmd);
+    fake_device* self = buf->dev;
+    self->begin_call(RESET_COMMAND_BUFFER);
+    std::unique_lock<std::mutex> lk(self->mutex);
+    buf->resets++;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::reset_command_pool(
+    VkDevice dev, VkCommandPool pool, VkCommandPoolResetFlags
+){
+    fake_device* self = from(dev);
+    self->begin_call(RESET_COMMAND_POOL);
+    std::unique_lock<std::mutex> lk(self->mutex);
+    auto* buffers = self->find(pool);
+    if(!buffers) return VK_ERROR_DEVICE_LOST;
+    for(auto& buf: *buffers)
+        buf->resets++;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL fake_device::destroy_command_pool(
+    VkDevice dev, VkCommandPool pool, const VkAllocationCallbacks*
+){
+    fake_device* self = from(dev);
+    self->begin_call(DESTROY_COMMAND_POOL);
+    if(pool == VK_NULL_HANDLE)
+        return;
+
+    std::unique_lock<std::mutex> lk(self->mutex);
+    if(self->find(pool))
+        self->command_pools.erase(handle_to_id(pool));
+    self->log.push_back({DESTROY_COMMAND_POOL, handle_to_id(pool)});
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::reset_descriptor_pool(
+    VkDevice dev, VkDescriptorPool pool, VkDescriptorPoolResetFlags
+){
+    fake_device* self = from(dev);
+    self->begin_call(RESET_DESCRIPTOR_POOL);
+    std::unique_lock<std::mutex> lk(self->mutex);
+    auto it = self->descriptor_pools.find(handle_to_id(pool));
+    if(it == self->descriptor_pools.end())
+    {
+        self->errors++;
+        return VK_ERROR_DEVICE_LOST;
+    }
+    it->second++;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL fake_device::destroy_descriptor_pool(
+    VkDevice dev, VkDescriptorPool pool, const VkAllocationCallbacks*
+){
+    fake_device* self = from(dev);
+    self->begin_call(DESTROY_DESCRIPTOR_POOL);
+    if(pool == VK_NULL_HANDLE)
+        return;
+
+    std::unique_lock<std::mutex> lk(self->mutex);
+    if(self->descriptor_pools.erase(handle_to_id(pool)) == 0)
+        self->errors++;
+    self->log.push_back({DESTROY_DESCRIPTOR_POOL, handle_to_id(pool)});
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::create_fence(
+    VkDevice dev, const VkFenceCreateInfo* info,
+    const VkAllocationCallbacks*, VkFence* fence
+){
+    fake_device* self = from(dev);
+    self->begin_call(CREATE_FENCE);
+    *fence = self->create_fence(info->flags & VK_FENCE_CREATE_SIGNALED_BIT);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::get_fence_status(VkDevice dev, VkFence fence)
+{
+    fake_device* self = from(dev);
+    self->begin_call(GET_FENCE_STATUS);
+    std::unique_lock<std::mutex> lk(self->mutex);
+    timeline* t = self->find(fence);
+    if(!t) return VK_ERROR_DEVICE_LOST;
+    return t->value != 0 ? VK_SUCCESS : VK_NOT_READY;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::wait_for_fences(
+    VkDevice dev, uint32_t count, const VkFence* fences,
+    VkBool32 wait_all, uint64_t timeout
+){
+    fake_device* self = from(dev);
+    self->begin_call(WAIT_FOR_FENCES);
+
+    std::unique_lock<std::mutex> lk(self->mutex);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        timeline* t = self->find(fences[i]);
+        if(!t) return VK_ERROR_DEVICE_LOST;
+        if(timeout != 0)
+            t->value = t->submitted;
+    }
+
+    auto done = [&]() {
+        uint32_t reached = 0;
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            timeline* t = self->find(fences[i]);
+            if(t && t->value != 0)
+                reached++;
+        }
+        return wait_all ? reached == count : reached != 0;
+    };
+
+    if(timeout == UINT64_MAX)
+        self->signaled.wait(lk, done);
+    else if(!self->signaled.wait_for(lk, std::chrono::nanoseconds(timeout), done))
+        return VK_TIMEOUT;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::reset_fences(
+    VkDevice dev, uint32_t count, const VkFence* fences
+){
+    fake_device* self = from(dev);
+    self->begin_call(RESET_FENCES);
+    std::unique_lock<std::mutex> lk(self->mutex);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        timeline* t = self->find(fences[i]);
+        if(t) t->value = t->submitted = 0;
+    }
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL fake_device::destroy_fence(
+    VkDevice dev, VkFence fence, const VkAllocationCallbacks*
+){
+    fake_device* self = from(dev);
+    self->begin_call(DESTROY_FENCE);
+    if(fence == VK_NULL_HANDLE)
+        return;
+
+    std::unique_lock<std::mutex> lk(self->mutex);
+    timeline* t = self->find(fence);
+    if(t)
+    {
+        if(t->submitted > t->value)
+            self->errors++;
+        self->fences.erase(handle_to_id(fence));
+    }
+    self->log.push_back({DESTROY_FENCE, handle_to_id(fence)});
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::create_semaphore(
+    VkDevice dev, const VkSemaphoreCreateInfo* info,
+    const VkAllocationCallbacks*, VkSemaphore* sem
+){
+    fake_device* self = from(dev);
+    self->begin_call(CREATE_SEMAPHORE);
+    // Binary semaphores are never waited for by the GC, so they can be
+    // timelines too.
+    uint64_t initial_value = 0;
+    for(
+        const VkSemaphoreTypeCreateInfo* next = (const VkSemaphoreTypeCreateInfo*)info->pNext;
+        next; next = (const VkSemaphoreTypeCreateInfo*)next->pNext
+    ){
+        if(next->sType == VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO)
+            initial_value = next->initialValue;
+    }
+    *sem = self->create_timeline(initial_value);
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL fake_device::queue_submit2(
+    VkQueue queue, uint32_t count, const VkSubmitInfo2* submits, VkFence fence
+){
+    fake_device* self = reinterpret_cast<submit_queue*>(queue)->dev;
+    self->begin_call(QUEUE_SUBMIT);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const VkSubmitInfo2& submit = submits[i];
+        for(uint32_t j = 0; j < submit.signalSemaphoreInfoCount; ++j)
+        {
+            const VkSemaphoreSubmitInfo& signal = submit.pSignalSemaphoreInfos[j];
+            self->submit(signal.semaphore, signal.value);
+        }
+        std::unique_lock<std::mutex> lk(self->mutex);
+        self->submitted_command_buffers += submit.commandBufferInfoCount;
+    }
+    if(fence != VK_NULL_HANDLE)
+        self->submit(fence);
+    return VK_SUCCESS;
+}
+
+}
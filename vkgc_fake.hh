@@ -0,0 +1,242 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+#ifndef VKGC_FAKE_DEVICE_HH
+#define VKGC_FAKE_DEVICE_HH
+
+#include "vkgc.hh"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace vkgc
+{
+
+// A stand-in for a Vulkan device that implements only the entry points the GC
+// uses. Timeline semaphores are plain counters controlled from the host, so the
+// GC can be tested and benchmarked deterministically on machines without a
+// GPU:
+//
+//     vkgc::fake_device dev;
+//     vkgc::garbage_collector gc(dev.device(), dev.dispatch());
+//
+// All functions are thread-safe.
+class fake_device
+{
+public:
+    enum entry_point
+    {
+        GET_SEMAPHORE_COUNTER_VALUE = 0,
+        DESTROY_SEMAPHORE,
+        WAIT_SEMAPHORES,
+        DEVICE_WAIT_IDLE,
+        ALLOCATE_COMMAND_BUFFERS,
+        RESET_COMMAND_BUFFER,
+        RESET_COMMAND_POOL,
+        DESTROY_COMMAND_POOL,
+        RESET_DESCRIPTOR_POOL,
+        DESTROY_DESCRIPTOR_POOL,
+        CREATE_FENCE,
+        GET_FENCE_STATUS,
+        WAIT_FOR_FENCES,
+        RESET_FENCES,
+        DESTROY_FENCE,
+        CREATE_SEMAPHORE,
+        QUEUE_SUBMIT,
+        ENTRY_POINT_COUNT
+    };
+
+    // A logged call to an entry point that destroys something.
+    struct call
+    {
+        entry_point func;
+        uint64_t handle;
+    };
+
+    fake_device();
+    fake_device(const fake_device&) = delete;
+    fake_device(fake_device&& other) noexcept = delete;
+    ~fake_device();
+
+    // Pass these two to the garbage_collector constructor.
+    VkDevice device();
+    dispatch_table dispatch() const;
+
+    VkSemaphore create_timeline(uint64_t initial_value = 0);
+
+    // Sets the counter value right away, like vkSignalSemaphore().
+    void signal(VkSemaphore sem, uint64_t value);
+
+    // Simulates a submission that signals 'value' once it's done. The fake
+    // "GPU" only finishes work when finish() is called or when something waits
+    // for it with vkWaitSemaphores() or vkDeviceWaitIdle(), so the host stays
+    // in control of when counters advance.
+    void submit(VkSemaphore sem, uint64_t value);
+
+    // Finishes all submitted work.
+    void finish();
+
+    uint64_t value(VkSemaphore sem) const;
+    bool alive(VkSemaphore sem) const;
+    size_t alive_semaphore_count() const;
+
+    // The queues' submissions just submit() the semaphores and fence they
+    // signal, waits are ignored. Queues are created on first use.
+    VkQueue queue(uint32_t index = 0);
+    // Number of command buffers submitted so far.
+    uint64_t submitted_command_buffer_count() const;
+
+    // Fences work like timelines with a single value: signal() sets them
+    // right away and submit() lets the "GPU" signal them later. Zero-timeout
+    // vkWaitForFences() calls are status queries and don't finish any work.
+    VkFence create_fence(bool signaled = false);
+    void signal(VkFence fence);
+    void submit(VkFence fence);
+    bool fence_signaled(VkFence fence) const;
+    bool alive_fence(VkFence fence) const;
+    size_t alive_fence_count() const;
+
+    // Command pools only keep track of their command buffers and how many
+    // times each one has been reset, nothing is ever recorded.
+    VkCommandPool create_command_pool();
+    bool alive_command_pool(VkCommandPool pool) const;
+    size_t command_buffer_count(VkCommandPool pool) const;
+    // Like vkAllocateCommandBuffers(), but not counted as a call.
+    VkCommandBuffer allocate_command_buffer(VkCommandPool pool);
+    // Counts both vkResetCommandBuffer() and resets through the pool.
+    uint64_t reset_count(VkCommandBuffer cmd) const;
+
+    // Descriptor pools only count their resets, sets aren't allocated.
+    VkDescriptorPool create_descriptor_pool();
+    bool alive_descriptor_pool(VkDescriptorPool pool) const;
+    uint64_t reset_count(VkDescriptorPool pool) const;
+
+    // Makes every call to the given entry point take at least 'latency'. Use
+    // this to emulate slow drivers in benchmarks.
+    void set_latency(entry_point func, std::chrono::nanoseconds latency);
+
+    uint64_t call_count(entry_point func) const;
+
+    // Number of calls that used a destroyed or unknown handle, or destroyed a
+    // semaphore or fence that submitted work was still going to signal.
+    uint64_t error_count() const;
+
+    // Destroy calls in the order they were made.
+    std::vector<call> destroy_log() const;
+    void clear_log();
+
+private:
+    struct timeline
+    {
+        uint64_t value;
+        uint64_t submitted;
+    };
+
+    // vkResetCommandBuffer() isn't given a device, so command buffers point
+    // back to theirs.
+    struct command_buffer
+    {
+        fake_device* dev;
+        uint64_t pool;
+        uint64_t resets;
+    };
+
+    // vkQueueSubmit2() isn't given a device either.
+    struct submit_queue
+    {
+        fake_device* dev;
+    };
+
+    void begin_call(entry_point func);
+    timeline* find(VkSemaphore sem);
+    std::vector<std::unique_ptr<command_buffer>>* find(VkCommandPool pool);
+    timeline* find(VkFence fence);
+
+    static fake_device* from(VkDevice dev);
+    static VKAPI_ATTR VkResult VKAPI_CALL get_semaphore_counter_value(
+        VkDevice dev, VkSemaphore sem, uint64_t* value);
+    static VKAPI_ATTR void VKAPI_CALL destroy_semaphore(
+        VkDevice dev, VkSemaphore sem, const VkAllocationCallbacks* alloc);
+    static VKAPI_ATTR VkResult VKAPI_CALL wait_semaphores(
+        VkDevice dev, const VkSemaphoreWaitInfo* info, uint64_t timeout);
+    static VKAPI_ATTR VkResult VKAPI_CALL device_wait_idle(VkDevice dev);
+    static VKAPI_ATTR VkResult VKAPI_CALL allocate_command_buffers(
+        VkDevice dev, const VkCommandBufferAllocateInfo* info, VkCommandBuffer* cmds);
+    static VKAPI_ATTR VkResult VKAPI_CALL reset_command_buffer(
+        VkCommandBuffer cmd, VkCommandBufferResetFlags flags);
+    static VKAPI_ATTR VkResult VKAPI_CALL reset_command_pool(
+        VkDevice dev, VkCommandPool pool, VkCommandPoolResetFlags flags);
+    static VKAPI_ATTR void VKAPI_CALL destroy_command_pool(
+        VkDevice dev, VkCommandPool pool, const VkAllocationCallbacks* alloc);
+    static VKAPI_ATTR VkResult VKAPI_CALL reset_descriptor_pool(
+        VkDevice dev, VkDescriptorPool pool, VkDescriptorPoolResetFlags flags);
+    static VKAPI_ATTR void VKAPI_CALL destroy_descriptor_pool(
+        VkDevice dev, VkDescriptorPool pool, const VkAllocationCallbacks* alloc);
+    static VKAPI_ATTR VkResult VKAPI_CALL create_semaphore(
+        VkDevice dev, const VkSemaphoreCreateInfo* info,
+        const VkAllocationCallbacks* alloc, VkSemaphore* sem);
+    static VKAPI_ATTR VkResult VKAPI_CALL queue_submit2(
+        VkQueue queue, uint32_t count, const VkSubmitInfo2* submits, VkFence fence);
+    static VKAPI_ATTR VkResult VKAPI_CALL create_fence(
+        VkDevice dev, const VkFenceCreateInfo* info,
+        const VkAllocationCallbacks* alloc, VkFence* fence);
+    static VKAPI_ATTR VkResult VKAPI_CALL get_fence_status(VkDevice dev, VkFence fence);
+    static VKAPI_ATTR VkResult VKAPI_CALL wait_for_fences(
+        VkDevice dev, uint32_t count, const VkFence* fences,
+        VkBool32 wait_all, uint64_t timeout);
+    static VKAPI_ATTR VkResult VKAPI_CALL reset_fences(
+        VkDevice dev, uint32_t count, const VkFence* fences);
+    static VKAPI_ATTR void VKAPI_CALL destroy_fence(
+        VkDevice dev, VkFence fence, const VkAllocationCallbacks* alloc);
+
+    mutable std::mutex mutex;
+    std::condition_variable signaled;
+    uint64_t handle_counter;
+    std::unordered_map<uint64_t, timeline> timelines;
+    std::unordered_map<
+        uint64_t, std::vector<std::unique_ptr<command_buffer>>
+    > command_pools;
+    // Reset counts.
+    std::unordered_map<uint64_t, uint64_t> descriptor_pools;
+    std::vector<std::unique_ptr<submit_queue>> queues;
+    uint64_t submitted_command_buffers;
+    // Signaled fences have a value of 1.
+    std::unordered_map<uint64_t, timeline> fences;
+    std::vector<call> log;
+
+    std::atomic<uint64_t> latency_ns[ENTRY_POINT_COUNT];
+    std::atomic<uint64_t> calls[ENTRY_POINT_COUNT];
+    std::atomic<uint64_t> errors;
+};
+
+}
+
+#endif
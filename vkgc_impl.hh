@@ -0,0 +1,2294 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+// Definitions of basic_garbage_collector. This is included by vkgc.hh, don't
+// include it directly.
+#ifndef VKGC_IMPL_HH
+#define VKGC_IMPL_HH
+#include <algorithm>
+
+namespace vkgc
+{
+
+#if VKGC_DEFAULT_DISPATCH
+template<typename Traits>
+basic_garbage_collector<Traits>::basic_garbage_collector(
+    VkDevice dev,
+    const allocator_type& alloc
+)
+: dev(dev), vk(dispatch_table::global()), alloc(alloc),
+  nodes(alloc), node_states(alloc), edge_blocks(alloc), resources(alloc), cascade(alloc),
+  trigger_infos(alloc), semaphore_infos(alloc), semaphore_dependencies(alloc),
+  fence_infos(alloc), fence_dependencies(alloc),
+  idle_fences(alloc), fence_batch(alloc), wait_semaphores(alloc), wait_values(alloc),
+  fence_resets(alloc),
+  queue_infos(alloc), queues(alloc),
+  recycle_infos(alloc), recycle_keys(alloc),
+  command_pool_infos(alloc), command_pools(alloc),
+  descriptor_pool_infos(alloc), descriptor_pools(alloc),
+  idle_descriptor_pools(alloc)
+{
+}
+#endif
+
+template<typename Traits>
+basic_garbage_collector<Traits>::basic_garbage_collector(
+    VkDevice dev,
+    const dispatch_table& vk,
+    const allocator_type& alloc
+)
+: dev(dev), vk(vk), alloc(alloc),
+  nodes(alloc), node_states(alloc), edge_blocks(alloc), resources(alloc), cascade(alloc),
+  trigger_infos(alloc), semaphore_infos(alloc), semaphore_dependencies(alloc),
+  fence_infos(alloc), fence_dependencies(alloc),
+  idle_fences(alloc), fence_batch(alloc), wait_semaphores(alloc), wait_values(alloc),
+  fence_resets(alloc),
+  queue_infos(alloc), queues(alloc),
+  recycle_infos(alloc), recycle_keys(alloc),
+  command_pool_infos(alloc), command_pools(alloc),
+  descriptor_pool_infos(alloc), descriptor_pools(alloc),
+  idle_descriptor_pools(alloc)
+{
+}
+
+template<typename Traits>
+basic_garbage_collector<Traits>::~basic_garbage_collector()
+{
+    leak_report leaks = build_report(std::chrono::steady_clock::duration::zero(), true);
+    if(leaks.empty())
+        return;
+
+    if(leak_handler)
+        leak_handler(leaks);
+#ifndef NDEBUG
+    else leaks.print(stderr);
+#endif
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release(
+    void* resource,
+    std::function<void()>&& cleanup,
+    call_site site
+){
+    if(!resource)
+    {
+        if(cleanup)
+            cleanup();
+        return;
+    }
+    std::unique_lock<lock_type> lk = lock();
+    release_node(get_slot(resource, site), std::move(cleanup), site);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release(
+    resource_id resource,
+    std::function<void()>&& cleanup,
+    call_site site
+){
+    std::unique_lock<lock_type> lk = lock();
+    uint32_t slot = get_slot(resource);
+    if(slot != none)
+        release_node(slot, std::move(cleanup), site);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release_recyclable(
+    void* resource,
+    uint64_t key,
+    size_t size,
+    std::function<void()>&& cleanup,
+    call_site site
+){
+    if(!resource)
+    {
+        if(cleanup)
+            cleanup();
+        return;
+    }
+    std::unique_lock<lock_type> lk = lock();
+    uint32_t slot = get_slot(resource, site);
+    // Key 0 can't be looked up, so the resource is just released.
+    if(key == 0 || !cleanup)
+    {
+        release_node(slot, std::move(cleanup), site);
+        return;
+    }
+    dependency_info& info = nodes[slot];
+    node_state& state = node_states[slot];
+    info.cleanup = std::move(cleanup);
+    state.released = true;
+    info.release_time = std::chrono::steady_clock::now();
+#if VKGC_CALL_SITES
+    info.released_at = site;
+#endif
+    if(state.kind != NODE_RECYCLABLE)
+    {
+        state.kind = NODE_RECYCLABLE;
+        info.owner = recycle_infos.acquire();
+        recycle_infos[info.owner].node = slot;
+    }
+    recycle_info& r = recycle_infos[info.owner];
+    r.key = key;
+    r.size = size;
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_RELEASE_RECYCLABLE);
+        recorder->resource((uint64_t)resource);
+        recorder->value(key);
+        recorder->value(size);
+    }
+#endif
+    check_delete(slot);
+}
+
+template<typename Traits>
+void* basic_garbage_collector<Traits>::acquire(uint64_t key)
+{
+    std::unique_lock<lock_type> lk = lock();
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_ACQUIRE);
+        recorder->value(key);
+    }
+#endif
+    if(key == 0)
+        return nullptr;
+    auto it = recycle_keys.find(key);
+    if(it == recycle_keys.end())
+        return nullptr;
+
+    uint32_t slot = it->second;
+    unpool(slot);
+    uint32_t node_slot = recycle_infos[slot].node;
+    dependency_info& info = nodes[node_slot];
+    info.cleanup = nullptr;
+    node_states[node_slot].released = false;
+    return info.resource;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::set_recycling_limits(
+    std::chrono::steady_clock::duration max_age,
+    size_t max_bytes
+){
+    std::unique_lock<lock_type> lk = lock();
+    recycle_max_age = max_age;
+    recycle_max_bytes = max_bytes;
+    while(pooled_bytes > recycle_max_bytes && oldest_pooled != none)
+        evict(oldest_pooled);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release(
+    VkCommandBuffer cmd,
+    VkCommandPool pool,
+    VkCommandBufferLevel level,
+    call_site site
+){
+    if(cmd == VK_NULL_HANDLE || pool == VK_NULL_HANDLE)
+        return;
+    std::unique_lock<lock_type> lk = lock();
+    uint32_t pool_slot = get_command_pool(pool);
+    command_pool_info& p = command_pool_infos[pool_slot];
+    uint32_t slot = get_slot(cmd, site);
+    dependency_info& info = nodes[slot];
+    node_state& state = node_states[slot];
+    // Command buffers from acquire_command_buffer() are already tracked.
+    if(state.kind == NODE_COMMAND_BUFFER)
+        p.recording--;
+    p.pending++;
+    state.kind = NODE_COMMAND_BUFFER;
+    info.owner = pool_slot;
+    info.secondary = level == VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    state.released = true;
+    info.release_time = std::chrono::steady_clock::now();
+#if VKGC_CALL_SITES
+    info.released_at = site;
+#endif
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_RELEASE_COMMAND_BUFFER);
+        recorder->resource((uint64_t)cmd);
+        recorder->command_pool((uint64_t)pool);
+        recorder->value(level);
+    }
+#endif
+    check_delete(slot);
+}
+
+template<typename Traits>
+VkCommandBuffer basic_garbage_collector<Traits>::acquire_command_buffer(
+    VkCommandPool pool,
+    VkCommandBufferLevel level,
+    VkCommandPoolCreateFlags pool_flags,
+    call_site site
+){
+    if(pool == VK_NULL_HANDLE)
+        return VK_NULL_HANDLE;
+    std::unique_lock<lock_type> lk = lock();
+    uint32_t pool_slot = get_command_pool(pool);
+    command_pool_info& p = command_pool_infos[pool_slot];
+    bool secondary = level == VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    vector<VkCommandBuffer>& clean = p.clean[secondary];
+    vector<VkCommandBuffer>& ready = p.ready[secondary];
+
+    // Once every command buffer is back, one pool reset is cheaper than
+    // resetting them individually.
+    if(clean.empty() && p.recording == 0 && p.pending == 0 && !ready.empty())
+    {
+        if(vk.vkResetCommandPool(dev, pool, 0) == VK_SUCCESS)
+        {
+            for(int i = 0; i < 2; ++i)
+            {
+                p.clean[i].insert(p.clean[i].end(), p.ready[i].begin(), p.ready[i].end());
+                p.ready[i].clear();
+            }
+        }
+    }
+
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    if(!clean.empty())
+    {
+        cmd = clean.back();
+        clean.pop_back();
+    }
+    else if(
+        (pool_flags & VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT) &&
+        !ready.empty() &&
+        vk.vkResetCommandBuffer(ready.back(), 0) == VK_SUCCESS
+    ){
+        cmd = ready.back();
+        ready.pop_back();
+    }
+    else
+    {
+        VkCommandBufferAllocateInfo info = {
+            VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            nullptr,
+            pool,
+            level,
+            1
+        };
+        if(vk.vkAllocateCommandBuffers(dev, &info, &cmd) != VK_SUCCESS)
+            return VK_NULL_HANDLE;
+    }
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_ACQUIRE_COMMAND_BUFFER);
+        recorder->command_pool((uint64_t)pool);
+        recorder->value(level);
+        recorder->value(pool_flags);
+        recorder->resource((uint64_t)cmd);
+    }
+#endif
+
+    uint32_t slot = get_slot(cmd, site);
+    dependency_info& info = nodes[slot];
+    node_states[slot].kind = NODE_COMMAND_BUFFER;
+    info.owner = pool_slot;
+    info.secondary = secondary;
+    p.recording++;
+    return cmd;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release_command_pool(VkCommandPool pool, call_site site)
+{
+    std::unique_lock<lock_type> lk = lock();
+    (void)site;
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_RELEASE_COMMAND_POOL);
+        recorder->command_pool((uint64_t)pool);
+    }
+#endif
+    auto it = command_pools.find(pool);
+    if(it == command_pools.end())
+    {
+        vk.vkDestroyCommandPool(dev, pool, nullptr);
+        return;
+    }
+    command_pool_infos[it->second].should_destroy = true;
+    check_destroy_command_pool(it->second);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release(
+    VkDescriptorSet set,
+    VkDescriptorPool pool,
+    call_site site
+){
+    if(set == VK_NULL_HANDLE || pool == VK_NULL_HANDLE)
+        return;
+    std::unique_lock<lock_type> lk = lock();
+    uint32_t pool_slot = get_descriptor_pool(pool);
+    uint32_t slot = get_slot((void*)set, site);
+    dependency_info& info = nodes[slot];
+    node_state& state = node_states[slot];
+    descriptor_pool_infos[pool_slot].pending++;
+    state.kind = NODE_DESCRIPTOR_SET;
+    info.owner = pool_slot;
+    state.released = true;
+    info.release_time = std::chrono::steady_clock::now();
+#if VKGC_CALL_SITES
+    info.released_at = site;
+#endif
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_RELEASE_DESCRIPTOR_SET);
+        recorder->resource((uint64_t)set);
+        recorder->descriptor_pool((uint64_t)pool);
+    }
+#endif
+    check_delete(slot);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release_recyclable(
+    VkDescriptorPool pool,
+    uint64_t key,
+    call_site site
+){
+    if(pool == VK_NULL_HANDLE)
+        return;
+    std::unique_lock<lock_type> lk = lock();
+    (void)site;
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_RELEASE_RECYCLABLE_DESCRIPTOR_POOL);
+        recorder->descriptor_pool((uint64_t)pool);
+        recorder->value(key);
+    }
+#endif
+    uint32_t slot = get_descriptor_pool(pool);
+    descriptor_pool_info& p = descriptor_pool_infos[slot];
+    // Key 0 can't be looked up, so the pool is destroyed instead.
+    p.state = key != 0 ? POOL_RECYCLE : POOL_DESTROY;
+    p.key = key;
+    check_descriptor_pool(slot);
+}
+
+template<typename Traits>
+VkDescriptorPool basic_garbage_collector<Traits>::acquire_descriptor_pool(uint64_t key)
+{
+    std::unique_lock<lock_type> lk = lock();
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_ACQUIRE_DESCRIPTOR_POOL);
+        recorder->value(key);
+    }
+#endif
+    if(key == 0)
+        return VK_NULL_HANDLE;
+    auto it = idle_descriptor_pools.find(key);
+    if(it == idle_descriptor_pools.end())
+        return VK_NULL_HANDLE;
+
+    descriptor_pool_info& p = descriptor_pool_infos[it->second];
+    if(p.next_idle != none)
+        it->second = p.next_idle;
+    else idle_descriptor_pools.erase(it);
+    p.next_idle = none;
+    p.state = POOL_IN_USE;
+    return p.pool;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release_descriptor_pool(
+    VkDescriptorPool pool,
+    call_site site
+){
+    std::unique_lock<lock_type> lk = lock();
+    (void)site;
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_RELEASE_DESCRIPTOR_POOL);
+        recorder->descriptor_pool((uint64_t)pool);
+    }
+#endif
+    auto it = descriptor_pools.find(pool);
+    if(it == descriptor_pools.end())
+    {
+        vk.vkDestroyDescriptorPool(dev, pool, nullptr);
+        return;
+    }
+    descriptor_pool_infos[it->second].state = POOL_DESTROY;
+    check_descriptor_pool(it->second);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release(VkSemaphore sem, call_site site)
+{
+    if(sem == VK_NULL_HANDLE)
+        return;
+    std::unique_lock<lock_type> lk = lock();
+    semaphore_info& info = get_semaphore(sem, site);
+    info.should_destroy = true;
+#if VKGC_CALL_SITES
+    info.released_at = site;
+#endif
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_RELEASE_SEMAPHORE);
+        recorder->semaphore((uint64_t)sem);
+    }
+#endif
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::depend(void* used_resource, void* user_resource, call_site site)
+{
+    depend_many(&used_resource, 1, user_resource, site);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::depend_many(
+    void** used_resources,
+    size_t used_resource_count,
+    void* user_resource,
+    call_site site
+){
+    if(!user_resource)
+        return;
+    std::unique_lock<lock_type> lk = lock();
+#if VKGC_TRACING
+    if(recorder && used_resource_count == 1)
+    {
+        recorder->begin(TRACE_DEPEND);
+        recorder->resource((uint64_t)used_resources[0]);
+        recorder->resource((uint64_t)user_resource);
+    }
+    else if(recorder)
+    {
+        recorder->begin(TRACE_DEPEND_MANY);
+        recorder->resource((uint64_t)user_resource);
+        recorder->value(used_resource_count);
+        for(size_t i = 0; i < used_resource_count; ++i)
+            recorder->resource((uint64_t)used_resources[i]);
+    }
+#endif
+    uint32_t user_slot = get_slot(user_resource, site);
+    for(size_t i = 0; i < used_resource_count; ++i)
+        if(used_resources[i])
+            add_dependency(get_slot(used_resources[i], site), user_slot);
+}
+
+template<typename Traits>
+resource_id basic_garbage_collector<Traits>::register_resource(void* resource, call_site site)
+{
+    if(!resource)
+        return resource_id();
+    std::unique_lock<lock_type> lk = lock();
+    bool tracked = resources.find(resource) != resources.end();
+    uint32_t slot = get_slot(resource, site);
+    // The all-ones slot is left out so that no id is UINT32_MAX. A resource
+    // that was only added for its id is dropped again.
+    if(slot >= (1u << id_slot_bits) - 1)
+    {
+        if(!tracked)
+        {
+            resources.erase(resources.find(resource));
+            free_node(slot);
+        }
+        return resource_id();
+    }
+    nodes[slot].has_id = true;
+    return resource_id(slot | uint32_t(node_states[slot].generation) << id_slot_bits);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::depend(
+    resource_id used_resource,
+    resource_id user_resource,
+    call_site site
+){
+    depend_many(&used_resource, 1, user_resource, site);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::depend_many(
+    const resource_id* used_resources,
+    size_t used_resource_count,
+    resource_id user_resource,
+    call_site site
+){
+    std::unique_lock<lock_type> lk = lock();
+    (void)site;
+    uint32_t user_slot = get_slot(user_resource);
+    if(user_slot == none)
+        return;
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_DEPEND_MANY);
+        recorder->resource((uint64_t)nodes[user_slot].resource);
+        size_t count = 0;
+        for(size_t i = 0; i < used_resource_count; ++i)
+            count += get_slot(used_resources[i]) != none;
+        recorder->value(count);
+        for(size_t i = 0; i < used_resource_count; ++i)
+        {
+            uint32_t slot = get_slot(used_resources[i]);
+            if(slot != none)
+                recorder->resource((uint64_t)nodes[slot].resource);
+        }
+    }
+#endif
+    for(size_t i = 0; i < used_resource_count; ++i)
+    {
+        uint32_t slot = get_slot(used_resources[i]);
+        if(slot != none)
+            add_dependency(slot, user_slot);
+    }
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::depend(
+    resource_id used_resource,
+    VkSemaphore timeline,
+    uint64_t value,
+    call_site site
+){
+    std::unique_lock<lock_type> lk = lock();
+    uint32_t slot = get_slot(used_resource);
+    if(slot == none)
+        return;
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_DEPEND_TIMELINE);
+        recorder->resource((uint64_t)nodes[slot].resource);
+        recorder->semaphore((uint64_t)timeline);
+        recorder->value(value);
+    }
+#endif
+    if(reached(timeline, value))
+        return;
+    node_states[slot].dependency_count++;
+    push_trigger(get_semaphore(timeline, site), value, slot, nullptr);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::depend_many(
+    const resource_id* used_resources,
+    size_t used_resource_count,
+    VkSemaphore timeline,
+    uint64_t value,
+    call_site site
+){
+    std::unique_lock<lock_type> lk = lock();
+#if VKGC_TRACING
+    if(recorder)
+    {
+        for(size_t i = 0; i < used_resource_count; ++i)
+        {
+            uint32_t slot = get_slot(used_resources[i]);
+            if(slot == none)
+                continue;
+            recorder->begin(TRACE_DEPEND_TIMELINE);
+            recorder->resource((uint64_t)nodes[slot].resource);
+            recorder->semaphore((uint64_t)timeline);
+            recorder->value(value);
+        }
+    }
+#endif
+    if(reached(timeline, value))
+        return;
+
+    uint32_t group = none;
+    for(size_t i = 0; i < used_resource_count; ++i)
+    {
+        uint32_t slot = get_slot(used_resources[i]);
+        if(slot == none)
+            continue;
+        node_states[slot].dependency_count++;
+        add_edge(group, slot);
+    }
+    if(group != none)
+        push_trigger(get_semaphore(timeline, site), value, none, nullptr, group);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::depend(
+    resource_id used_resource,
+    VkFence fence,
+    call_site site
+){
+    std::unique_lock<lock_type> lk = lock();
+    (void)site;
+    uint32_t slot = get_slot(used_resource);
+    if(slot == none || fence == VK_NULL_HANDLE)
+        return;
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_DEPEND_FENCE);
+        recorder->resource((uint64_t)nodes[slot].resource);
+        recorder->fence((uint64_t)fence);
+    }
+#endif
+    node_states[slot].dependency_count++;
+    uint32_t trigger_slot = trigger_infos.acquire();
+    trigger_infos[trigger_slot].dependent = slot;
+    trigger_infos[trigger_slot].callback = nullptr;
+    fence_infos[get_fence(fence)].triggers.push_back(trigger_slot);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::depend(
+    void* used_resource,
+    VkSemaphore timeline,
+    uint64_t value,
+    call_site site
+){
+    if(!used_resource)
+        return;
+    std::unique_lock<lock_type> lk = lock();
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_DEPEND_TIMELINE);
+        recorder->resource((uint64_t)used_resource);
+        recorder->semaphore((uint64_t)timeline);
+        recorder->value(value);
+    }
+#endif
+    if(reached(timeline, value))
+        return;
+    uint32_t slot = get_slot(used_resource, site);
+    node_states[slot].dependency_count++;
+    push_trigger(get_semaphore(timeline, site), value, slot, nullptr);
+}
+
+template<typename Traits>
+VkResult basic_garbage_collector<Traits>::submit(
+    VkQueue queue,
+    uint32_t submit_count,
+    const VkSubmitInfo2* submits,
+    VkFence fence,
+    call_site site
+){
+    std::unique_lock<lock_type> lk = lock();
+    auto it = queues.find(queue);
+    uint32_t slot;
+    if(it != queues.end())
+        slot = it->second;
+    else
+    {
+        VkSemaphoreTypeCreateInfo type_info = {
+            VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+            nullptr,
+            VK_SEMAPHORE_TYPE_TIMELINE,
+            0
+        };
+        VkSemaphoreCreateInfo info = {
+            VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+            &type_info,
+            0
+        };
+        VkSemaphore timeline = VK_NULL_HANDLE;
+        VkResult res = vk.vkCreateSemaphore(dev, &info, nullptr, &timeline);
+        if(res != VK_SUCCESS)
+            return res;
+        slot = queue_infos.acquire(alloc);
+        queues.emplace(queue, slot);
+        queue_infos[slot].queue = queue;
+        queue_infos[slot].timeline = timeline;
+    }
+    // The lock is held throughout, so that wait_collect() can't release the
+    // timeline while a signal of it is being submitted.
+    queue_info& q = queue_infos[slot];
+    uint64_t value = ++q.value;
+
+    q.submits.assign(submits, submits + submit_count);
+    if(submit_count == 0)
+    {
+        VkSubmitInfo2 empty = {};
+        empty.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        q.submits.push_back(empty);
+    }
+    VkSubmitInfo2& last = q.submits.back();
+    q.signals.assign(
+        last.pSignalSemaphoreInfos,
+        last.pSignalSemaphoreInfos + last.signalSemaphoreInfoCount
+    );
+    VkSemaphoreSubmitInfo signal = {
+        VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO,
+        nullptr,
+        q.timeline,
+        value,
+        VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+        0
+    };
+    q.signals.push_back(signal);
+    last.signalSemaphoreInfoCount = (uint32_t)q.signals.size();
+    last.pSignalSemaphoreInfos = q.signals.data();
+
+    VkResult res = vk.vkQueueSubmit2(
+        queue, (uint32_t)q.submits.size(), q.submits.data(), fence
+    );
+    if(res != VK_SUCCESS)
+    {
+        // Nothing was signaled, so the next submit can have the value.
+        q.value--;
+        return res;
+    }
+
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_SUBMIT);
+        recorder->queue((uint64_t)queue);
+        recorder->semaphore((uint64_t)q.timeline);
+        recorder->value(value);
+        recorder->fence((uint64_t)fence);
+        size_t count = 0;
+        for(uint32_t i = 0; i < submit_count; ++i)
+            count += submits[i].commandBufferInfoCount;
+        recorder->value(count);
+        for(uint32_t i = 0; i < submit_count; ++i)
+            for(uint32_t j = 0; j < submits[i].commandBufferInfoCount; ++j)
+                recorder->resource((uint64_t)submits[i].pCommandBufferInfos[j].commandBuffer);
+    }
+#endif
+    uint32_t group = none;
+    for(uint32_t i = 0; i < submit_count; ++i)
+    {
+        for(uint32_t j = 0; j < submits[i].commandBufferInfoCount; ++j)
+        {
+            VkCommandBuffer handle = submits[i].pCommandBufferInfos[j].commandBuffer;
+            if(handle == VK_NULL_HANDLE)
+                continue;
+            uint32_t cmd = get_slot(handle, site);
+            node_states[cmd].dependency_count++;
+            add_edge(group, cmd);
+        }
+    }
+    if(group != none)
+        push_trigger(get_semaphore(q.timeline, site), value, none, nullptr, group);
+    return VK_SUCCESS;
+}
+
+template<typename Traits>
+VkSemaphore basic_garbage_collector<Traits>::get_queue_timeline(
+    VkQueue queue,
+    uint64_t* value
+){
+    std::unique_lock<lock_type> lk = lock();
+    auto it = queues.find(queue);
+    if(it == queues.end())
+        return VK_NULL_HANDLE;
+    const queue_info& q = queue_infos[it->second];
+    if(value)
+        *value = q.value;
+    return q.timeline;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::collect()
+{
+    std::unique_lock<lock_type> lk = lock();
+#if VKGC_TRACING
+    if(recorder)
+        recorder->begin(TRACE_COLLECT);
+#endif
+    for(uint32_t slot = 0; slot < semaphore_infos.size(); ++slot)
+    {
+        semaphore_info& info = semaphore_infos[slot];
+        if(info.handle == VK_NULL_HANDLE)
+            continue;
+
+        uint64_t value = 0;
+        vk.vkGetSemaphoreCounterValue(dev, info.handle, &value);
+        info.last_value = std::max(info.last_value, value);
+#if VKGC_TRACING
+        if(recorder)
+            recorder->observe((uint64_t)info.handle, value);
+#endif
+
+        auto& triggers = info.triggers;
+        if(!triggers.empty() && triggers.front().value <= value)
+            info.last_progress = std::chrono::steady_clock::now();
+
+        while(!triggers.empty() && triggers.front().value <= value)
+        {
+            std::pop_heap(triggers.begin(), triggers.end());
+            uint32_t trigger_slot = triggers.back().slot;
+            triggers.pop_back();
+
+            fire_trigger(trigger_slot);
+        }
+
+        if(triggers.empty() && info.should_destroy)
+        {
+            vk.vkDestroySemaphore(dev, info.handle, nullptr);
+            semaphore_dependencies.erase(semaphore_dependencies.find(info.handle));
+            info.handle = VK_NULL_HANDLE;
+            info.should_destroy = false;
+            info.last_value = 0;
+            semaphore_infos.release(slot);
+        }
+    }
+
+    if(fence_dependencies.size() != 0)
+        poll_fences();
+
+    if(oldest_pooled != none)
+    {
+        auto now = std::chrono::steady_clock::now();
+        while(oldest_pooled != none && now - recycle_infos[oldest_pooled].pooled_time > recycle_max_age)
+            evict(oldest_pooled);
+    }
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::wait_collect()
+{
+    wait_collect(UINT64_MAX);
+}
+
+template<typename Traits>
+VkResult basic_garbage_collector<Traits>::wait_collect(
+    uint64_t timeout,
+    leak_report* leftovers
+){
+    collect();
+    std::unique_lock<lock_type> lk = lock();
+
+    // The queue timelines are destroyed along with the other released
+    // semaphores below.
+    release_queues();
+
+    // Reaching the highest pending value of each semaphore clears all of its
+    // triggers.
+    wait_semaphores.clear();
+    wait_values.clear();
+    for(uint32_t slot = 0; slot < semaphore_infos.size(); ++slot)
+    {
+        const semaphore_info& info = semaphore_infos[slot];
+        if(info.handle == VK_NULL_HANDLE || info.triggers.empty())
+            continue;
+        uint64_t value = 0;
+        for(const trigger& t: info.triggers)
+            value = std::max(value, t.value);
+        wait_semaphores.push_back(info.handle);
+        wait_values.push_back(value);
+    }
+
+    // Released fences are waited for even without triggers, so that they
+    // can be destroyed or reset.
+    fence_batch.clear();
+    for(uint32_t slot = 0; slot < fence_infos.size(); ++slot)
+    {
+        const fence_info& info = fence_infos[slot];
+        if(
+            info.handle != VK_NULL_HANDLE &&
+            (!info.triggers.empty() || info.state != FENCE_IN_USE)
+        ) fence_batch.push_back(info.handle);
+    }
+
+    VkResult res = wait_pending(timeout);
+    lk.unlock();
+    collect();
+    lk.lock();
+
+    while(oldest_pooled != none)
+        evict(oldest_pooled);
+
+    for(uint32_t slot = 0; slot < descriptor_pool_infos.size(); ++slot)
+    {
+        descriptor_pool_info& p = descriptor_pool_infos[slot];
+        if(p.pool != VK_NULL_HANDLE && p.state == POOL_IDLE)
+        {
+            auto it = idle_descriptor_pools.find(p.key);
+            if(it != idle_descriptor_pools.end())
+                idle_descriptor_pools.erase(it);
+            destroy_descriptor_pool(slot);
+        }
+    }
+
+    for(VkFence fence: idle_fences)
+        vk.vkDestroyFence(dev, fence, nullptr);
+    idle_fences.clear();
+    lk.unlock();
+
+    if(leftovers)
+        *leftovers = build_report(std::chrono::steady_clock::duration::zero(), false);
+    return res;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::teardown()
+{
+    std::unique_lock<lock_type> lk = lock();
+    release_queues();
+
+    // Nothing is waited for anymore, so only the callbacks are left to run.
+    // The dependents are dealt with by the topological pass below.
+    for(uint32_t slot = 0; slot < semaphore_infos.size(); ++slot)
+    {
+        auto& triggers = semaphore_infos[slot].triggers;
+        if(semaphore_infos[slot].handle == VK_NULL_HANDLE || triggers.empty())
+            continue;
+        std::sort(triggers.begin(), triggers.end(), [](const trigger& a, const trigger& b){
+            return a.value < b.value;
+        });
+        for(const trigger& t: triggers)
+        {
+            trigger_info& ti = trigger_infos[t.slot];
+            if(ti.callback)
+                ti.callback();
+        }
+    }
+    for(uint32_t slot = 0; slot < fence_infos.size(); ++slot)
+    {
+        if(fence_infos[slot].handle == VK_NULL_HANDLE)
+            continue;
+        for(uint32_t trigger_slot: fence_infos[slot].triggers)
+        {
+            trigger_info& ti = trigger_infos[trigger_slot];
+            if(ti.callback)
+                ti.callback();
+        }
+    }
+
+    // Kahn's algorithm over the edges between nodes. The dependency counts
+    // are recounted from the edges alone, as the triggers are gone, so only
+    // edges from nodes that are left count.
+    uint32_t node_count = nodes.size();
+    for(node_state& state: node_states)
+        state.dependency_count = 0;
+    for(uint32_t slot = 0; slot < node_count; ++slot)
+    {
+        const dependency_info& info = nodes[slot];
+        if(info.resource)
+            for_each_edge(info.edges, [&](uint32_t dep){ node_states[dep].dependency_count++; });
+    }
+
+    // Free slots aren't released, so they never get in.
+    vector<uint32_t> level(alloc), next_level(alloc), batch(alloc);
+    for(uint32_t slot = 0; slot < node_count; ++slot)
+        if(node_states[slot].dependency_count == 0 && node_states[slot].released)
+            level.push_back(slot);
+
+    // The nodes of a level don't depend on each other, so they're run
+    // grouped by kind: command buffers and descriptor sets first, as they
+    // only update their pools.
+    size_t destroyed = 0;
+    while(!level.empty())
+    {
+        batch.clear();
+        for(node_kind kind: {NODE_COMMAND_BUFFER, NODE_DESCRIPTOR_SET})
+            for(uint32_t slot: level)
+                if(node_states[slot].kind == kind)
+                    batch.push_back(slot);
+        for(uint32_t slot: level)
+            if(node_states[slot].kind < NODE_COMMAND_BUFFER)
+                batch.push_back(slot);
+
+        next_level.clear();
+        for(uint32_t slot: batch)
+        {
+            dependency_info& info = nodes[slot];
+            node_state& state = node_states[slot];
+            if(state.kind == NODE_COMMAND_BUFFER)
+            {
+                command_pool_info& p = command_pool_infos[info.owner];
+                p.ready[info.secondary].push_back((VkCommandBuffer)info.resource);
+                p.pending--;
+            }
+            else if(state.kind == NODE_DESCRIPTOR_SET)
+                descriptor_pool_infos[info.owner].pending--;
+            else if(info.cleanup)
+                info.cleanup();
+            if(state.kind == NODE_RECYCLABLE)
+                recycle_infos[info.owner].pooled = false;
+
+            for_each_edge(info.edges, [&](uint32_t dep){
+                node_state& dep_state = node_states[dep];
+                if(--dep_state.dependency_count == 0 && dep_state.released)
+                    next_level.push_back(dep);
+            });
+
+            // The edges are freed in bulk below.
+            info.cleanup = nullptr;
+            info.resource = nullptr;
+            info.edges = none;
+            info.owner = none;
+            info.secondary = false;
+            state.kind = NODE_CLEANUP;
+            state.released = false;
+            next_generation(slot);
+        }
+        destroyed += batch.size();
+        std::swap(level, next_level);
+    }
+
+    // Every trigger is gone, along with its group.
+    for(uint32_t slot = 0; slot < trigger_infos.size(); ++slot)
+    {
+        trigger_info& t = trigger_infos[slot];
+        t.dependent = none;
+        t.group = none;
+        t.callback = nullptr;
+    }
+    trigger_infos.clear();
+
+    for(uint32_t slot = 0; slot < semaphore_infos.size(); ++slot)
+    {
+        semaphore_info& info = semaphore_infos[slot];
+        if(info.handle == VK_NULL_HANDLE)
+            continue;
+        info.triggers.clear();
+        if(info.should_destroy)
+        {
+            vk.vkDestroySemaphore(dev, info.handle, nullptr);
+            semaphore_dependencies.erase(semaphore_dependencies.find(info.handle));
+            info.handle = VK_NULL_HANDLE;
+            info.should_destroy = false;
+            info.last_value = 0;
+            semaphore_infos.release(slot);
+        }
+    }
+
+    // Unreleased fences have nothing left to wait for, so they're forgotten.
+    for(uint32_t slot = 0; slot < fence_infos.size(); ++slot)
+    {
+        fence_info& info = fence_infos[slot];
+        if(info.handle != VK_NULL_HANDLE && info.state != FENCE_IN_USE)
+            vk.vkDestroyFence(dev, info.handle, nullptr);
+        info.handle = VK_NULL_HANDLE;
+        info.state = FENCE_IN_USE;
+        info.triggers.clear();
+    }
+    fence_infos.clear();
+    fence_dependencies.clear();
+    for(VkFence fence: idle_fences)
+        vk.vkDestroyFence(dev, fence, nullptr);
+    idle_fences.clear();
+
+    // Whatever is left is unreleased, used by something unreleased or in a
+    // cycle, and only keeps the dependencies of its remaining users.
+    bool survivors = resources.size() != destroyed;
+    resources.clear();
+    recycle_keys.clear();
+    newest_pooled = none;
+    oldest_pooled = none;
+    pooled_bytes = 0;
+    if(!survivors)
+    {
+        nodes.reclaim([&](uint32_t slot){ return !nodes[slot].retired; });
+        edge_blocks.clear();
+        recycle_infos.clear();
+    }
+    else
+    {
+        vector<uint8_t> live_edges(edge_blocks.size(), 0, alloc);
+        vector<uint8_t> live_recycles(recycle_infos.size(), 0, alloc);
+        for(uint32_t slot = 0; slot < node_count; ++slot)
+        {
+            dependency_info& info = nodes[slot];
+            if(!info.resource)
+                continue;
+            resources.emplace(info.resource, slot);
+            for(uint32_t block = info.edges; block != none; block = edge_blocks[block].next)
+                live_edges[block] = 1;
+            if(node_states[slot].kind == NODE_RECYCLABLE)
+                live_recycles[info.owner] = 1;
+        }
+        nodes.reclaim([&](uint32_t slot){
+            return !nodes[slot].resource && !nodes[slot].retired;
+        });
+        edge_blocks.reclaim([&](uint32_t slot){ return !live_edges[slot]; });
+        recycle_infos.reclaim([&](uint32_t slot){ return !live_recycles[slot]; });
+    }
+
+    for(uint32_t slot = 0; slot < command_pool_infos.size(); ++slot)
+        if(command_pool_infos[slot].pool != VK_NULL_HANDLE)
+            check_destroy_command_pool(slot);
+
+    // Idle pools have no pending sets, and aren't going to be acquired again.
+    idle_descriptor_pools.clear();
+    for(uint32_t slot = 0; slot < descriptor_pool_infos.size(); ++slot)
+    {
+        descriptor_pool_info& p = descriptor_pool_infos[slot];
+        if(p.pool != VK_NULL_HANDLE && p.state != POOL_IN_USE && p.pending == 0)
+            destroy_descriptor_pool(slot);
+    }
+}
+
+template<typename Traits>
+VkResult basic_garbage_collector<Traits>::wait_destroyed(void* resource, uint64_t timeout)
+{
+    std::unique_lock<lock_type> lk = lock();
+    if(resources.find(resource) == resources.end())
+        return VK_SUCCESS;
+
+    // Everything that must go before 'resource' is found through backwards
+    // edges, which the graph doesn't store, so this is a full scan.
+    std::unordered_multimap<void* /*used*/, void* /*user*/> users;
+    for(uint32_t slot = 0; slot < nodes.size(); ++slot)
+    {
+        dependency_info& user = nodes[slot];
+        if(user.resource)
+            for_each_edge(user.edges, [&](uint32_t dep){
+                users.emplace(nodes[dep].resource, user.resource);
+            });
+    }
+    std::unordered_set<void*> blockers;
+    std::vector<void*> queue;
+    blockers.insert(resource);
+    queue.push_back(resource);
+    for(size_t i = 0; i < queue.size(); ++i)
+    {
+        // No amount of waiting helps with unreleased users.
+        if(!node_states[resources.find(queue[i])->second].released)
+            return VK_NOT_READY;
+        auto range = users.equal_range(queue[i]);
+        for(auto it = range.first; it != range.second; ++it)
+            if(blockers.insert(it->second).second)
+                queue.push_back(it->second);
+    }
+
+    wait_semaphores.clear();
+    wait_values.clear();
+    for(uint32_t slot = 0; slot < semaphore_infos.size(); ++slot)
+    {
+        const semaphore_info& info = semaphore_infos[slot];
+        if(info.handle == VK_NULL_HANDLE)
+            continue;
+        bool blocking = false;
+        uint64_t value = 0;
+        for(const trigger& t: info.triggers)
+        {
+            const trigger_info& ti = trigger_infos[t.slot];
+            bool hit = ti.dependent != none && blockers.count(nodes[ti.dependent].resource);
+            for_each_edge(ti.group, [&](uint32_t dep){
+                hit = hit || blockers.count(nodes[dep].resource);
+            });
+            if(hit)
+            {
+                blocking = true;
+                value = std::max(value, t.value);
+            }
+        }
+        if(blocking)
+        {
+            wait_semaphores.push_back(info.handle);
+            wait_values.push_back(value);
+        }
+    }
+
+    fence_batch.clear();
+    for(uint32_t slot = 0; slot < fence_infos.size(); ++slot)
+    {
+        const fence_info& info = fence_infos[slot];
+        if(info.handle == VK_NULL_HANDLE)
+            continue;
+        for(uint32_t trigger_slot: info.triggers)
+        {
+            uint32_t dependent = trigger_infos[trigger_slot].dependent;
+            if(dependent != none && blockers.count(nodes[dependent].resource))
+            {
+                fence_batch.push_back(info.handle);
+                break;
+            }
+        }
+    }
+
+    VkResult res = wait_pending(timeout);
+    lk.unlock();
+    collect();
+    lk.lock();
+
+    // Whatever is idle in the recycling pool can go right away.
+    for(void* blocker: queue)
+    {
+        auto it = resources.find(blocker);
+        if(it == resources.end())
+            continue;
+        const dependency_info& info = nodes[it->second];
+        if(node_states[it->second].kind == NODE_RECYCLABLE && recycle_infos[info.owner].pooled)
+            evict(info.owner);
+    }
+    if(resources.find(resource) == resources.end())
+        return VK_SUCCESS;
+    return res == VK_SUCCESS ? VK_NOT_READY : res;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::add_trigger(
+    VkSemaphore timeline,
+    uint64_t value,
+    std::function<void()>&& callback,
+    call_site site
+){
+    if(timeline == VK_NULL_HANDLE)
+    {
+        if(callback)
+            callback();
+        return;
+    }
+    std::unique_lock<lock_type> lk = lock();
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_ADD_TRIGGER);
+        recorder->semaphore((uint64_t)timeline);
+        recorder->value(value);
+    }
+#endif
+    push_trigger(get_semaphore(timeline, site), value, none, std::move(callback));
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::depend_many(
+    void** used_resources,
+    size_t used_resource_count,
+    VkSemaphore timeline,
+    uint64_t value,
+    call_site site
+){
+    std::unique_lock<lock_type> lk = lock();
+#if VKGC_TRACING
+    // Traces have no group op, individual depends replay the same way.
+    if(recorder)
+    {
+        for(size_t i = 0; i < used_resource_count; ++i)
+        {
+            recorder->begin(TRACE_DEPEND_TIMELINE);
+            recorder->resource((uint64_t)used_resources[i]);
+            recorder->semaphore((uint64_t)timeline);
+            recorder->value(value);
+        }
+    }
+#endif
+    if(used_resource_count == 0 || reached(timeline, value))
+        return;
+
+    uint32_t group = none;
+    for(size_t i = 0; i < used_resource_count; ++i)
+    {
+        if(!used_resources[i])
+            continue;
+        uint32_t slot = get_slot(used_resources[i], site);
+        node_states[slot].dependency_count++;
+        add_edge(group, slot);
+    }
+    if(group != none)
+        push_trigger(get_semaphore(timeline, site), value, none, nullptr, group);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::depend(
+    void* used_resource,
+    VkFence fence,
+    call_site site
+){
+    if(!used_resource || fence == VK_NULL_HANDLE)
+        return;
+    std::unique_lock<lock_type> lk = lock();
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_DEPEND_FENCE);
+        recorder->resource((uint64_t)used_resource);
+        recorder->fence((uint64_t)fence);
+    }
+#endif
+    uint32_t node_slot = get_slot(used_resource, site);
+    node_states[node_slot].dependency_count++;
+    uint32_t slot = trigger_infos.acquire();
+    trigger_infos[slot].dependent = node_slot;
+    trigger_infos[slot].callback = nullptr;
+    fence_infos[get_fence(fence)].triggers.push_back(slot);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::add_trigger(
+    VkFence fence,
+    std::function<void()>&& callback,
+    call_site site
+){
+    if(fence == VK_NULL_HANDLE)
+    {
+        if(callback)
+            callback();
+        return;
+    }
+    std::unique_lock<lock_type> lk = lock();
+    (void)site;
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_ADD_FENCE_TRIGGER);
+        recorder->fence((uint64_t)fence);
+    }
+#endif
+    uint32_t slot = trigger_infos.acquire();
+    trigger_infos[slot].dependent = none;
+    trigger_infos[slot].callback = std::move(callback);
+    fence_infos[get_fence(fence)].triggers.push_back(slot);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release_fence(VkFence fence, call_site site)
+{
+    if(fence == VK_NULL_HANDLE)
+        return;
+    std::unique_lock<lock_type> lk = lock();
+    (void)site;
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_RELEASE_FENCE);
+        recorder->fence((uint64_t)fence);
+    }
+#endif
+    fence_infos[get_fence(fence)].state = FENCE_DESTROY;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release_recyclable(VkFence fence, call_site site)
+{
+    if(fence == VK_NULL_HANDLE)
+        return;
+    std::unique_lock<lock_type> lk = lock();
+    (void)site;
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_RELEASE_RECYCLABLE_FENCE);
+        recorder->fence((uint64_t)fence);
+    }
+#endif
+    fence_infos[get_fence(fence)].state = FENCE_RECYCLE;
+}
+
+template<typename Traits>
+VkFence basic_garbage_collector<Traits>::acquire_fence()
+{
+    std::unique_lock<lock_type> lk = lock();
+    VkFence fence = VK_NULL_HANDLE;
+    if(!idle_fences.empty())
+    {
+        fence = idle_fences.back();
+        idle_fences.pop_back();
+    }
+    else
+    {
+        VkFenceCreateInfo info = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr, 0};
+        if(vk.vkCreateFence(dev, &info, nullptr, &fence) != VK_SUCCESS)
+            return VK_NULL_HANDLE;
+    }
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_ACQUIRE_FENCE);
+        recorder->fence((uint64_t)fence);
+    }
+#endif
+    return fence;
+}
+
+template<typename Traits>
+uint64_t basic_garbage_collector<Traits>::query_value(VkSemaphore timeline)
+{
+    std::unique_lock<lock_type> lk = lock();
+    auto it = semaphore_dependencies.find(timeline);
+    return it == semaphore_dependencies.end() ? 0 : semaphore_infos[it->second].last_value;
+}
+
+template<typename Traits>
+explanation basic_garbage_collector<Traits>::explain(void* resource)
+{
+    std::unique_lock<lock_type> lk = lock();
+    explanation ex;
+    auto node = resources.find(resource);
+    if(node == resources.end())
+        return ex;
+
+    // The graph only stores edges from users to used resources, so the
+    // backwards edges, timeline waits and fence waits have to be gathered
+    // first.
+    std::unordered_multimap<void* /*used*/, void* /*user*/> users;
+    for(uint32_t slot = 0; slot < nodes.size(); ++slot)
+    {
+        dependency_info& user = nodes[slot];
+        if(user.resource)
+            for_each_edge(user.edges, [&](uint32_t dep){
+                users.emplace(nodes[dep].resource, user.resource);
+            });
+    }
+
+    struct timeline_wait
+    {
+        VkSemaphore timeline;
+        uint64_t value;
+    };
+    std::unordered_map<void*, timeline_wait> waits;
+    for(uint32_t slot = 0; slot < semaphore_infos.size(); ++slot)
+    {
+        semaphore_info& info = semaphore_infos[slot];
+        if(info.handle == VK_NULL_HANDLE)
+            continue;
+        for(const trigger& t: info.triggers)
+        {
+            auto add_wait = [&](void* dependent) {
+                auto it = waits.find(dependent);
+                if(it == waits.end())
+                    waits[dependent] = {info.handle, t.value};
+                else if(it->second.value < t.value)
+                    it->second = {info.handle, t.value};
+            };
+            const trigger_info& ti = trigger_infos[t.slot];
+            if(ti.dependent != none)
+                add_wait(nodes[ti.dependent].resource);
+            for_each_edge(ti.group, [&](uint32_t dep){ add_wait(nodes[dep].resource); });
+        }
+    }
+    std::unordered_map<void*, VkFence> fence_waits;
+    for(uint32_t slot = 0; slot < fence_infos.size(); ++slot)
+    {
+        const fence_info& info = fence_infos[slot];
+        if(info.handle == VK_NULL_HANDLE)
+            continue;
+        for(uint32_t trigger_slot: info.triggers)
+        {
+            const trigger_info& ti = trigger_infos[trigger_slot];
+            if(ti.dependent != none)
+                fence_waits.emplace(nodes[ti.dependent].resource, info.handle);
+        }
+    }
+
+    // Breadth-first search, so that the reported chain is the shortest one.
+    std::unordered_map<void* /*user*/, void* /*used*/> parent;
+    std::vector<void*> queue;
+    parent[resource] = nullptr;
+    queue.push_back(resource);
+    void* unreleased = nullptr;
+    void* waiting = nullptr;
+    void* pooled = nullptr;
+    for(size_t i = 0; i < queue.size(); ++i)
+    {
+        void* res = queue[i];
+        uint32_t slot = resources.find(res)->second;
+        if(!node_states[slot].released)
+        {
+            unreleased = res;
+            break;
+        }
+        if(!waiting && (waits.count(res) || fence_waits.count(res)))
+            waiting = res;
+        // Pooled users keep what they use until they're evicted.
+        if(!pooled && node_states[slot].kind == NODE_RECYCLABLE &&
+            recycle_infos[nodes[slot].owner].pooled)
+            pooled = res;
+
+        auto range = users.equal_range(res);
+        for(auto it = range.first; it != range.second; ++it)
+        {
+            if(parent.emplace(it->second, res).second)
+                queue.push_back(it->second);
+        }
+    }
+
+    void* blocker = unreleased ? unreleased : waiting ? waiting : pooled;
+    if(blocker)
+    {
+        for(void* res = blocker; res; res = parent[res])
+            ex.chain.push_back(res);
+        std::reverse(ex.chain.begin(), ex.chain.end());
+    }
+
+    if(unreleased)
+        ex.reason = explanation::NOT_RELEASED;
+    else if(waiting && !waits.count(waiting))
+    {
+        ex.reason = explanation::FENCE;
+        ex.fence = fence_waits[waiting];
+    }
+    else if(waiting)
+    {
+        const timeline_wait& wait = waits[waiting];
+        ex.reason = explanation::TIMELINE;
+        ex.timeline = wait.timeline;
+        ex.wait_value = wait.value;
+        vk.vkGetSemaphoreCounterValue(dev, wait.timeline, &ex.current_value);
+    }
+    else if(pooled)
+        ex.reason = explanation::POOLED;
+    else
+    {
+        // Everything reachable is released, not waiting for anything and not
+        // pooled, yet still has users. That can only happen if the users loop
+        // back, so follow them until a resource repeats.
+        ex.reason = explanation::CYCLE;
+        void* res = resource;
+        while(std::find(ex.chain.begin(), ex.chain.end(), res) == ex.chain.end())
+        {
+            ex.chain.push_back(res);
+            auto it = users.find(res);
+            if(it == users.end())
+                return ex;
+            res = it->second;
+        }
+        ex.chain.push_back(res);
+    }
+    return ex;
+}
+
+template<typename Traits>
+leak_report basic_garbage_collector<Traits>::report(
+    std::chrono::steady_clock::duration stale_threshold
+){
+    return build_report(stale_threshold, false);
+}
+
+template<typename Traits>
+typename basic_garbage_collector<Traits>::allocator_type
+basic_garbage_collector<Traits>::get_allocator() const
+{
+    return alloc;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::set_leak_handler(
+    std::function<void(const leak_report&)>&& handler
+){
+    std::unique_lock<lock_type> lk = lock();
+    leak_handler = std::move(handler);
+}
+
+template<typename Traits>
+leak_report basic_garbage_collector<Traits>::build_report(
+    std::chrono::steady_clock::duration stale_threshold,
+    bool final_report
+){
+    std::unique_lock<lock_type> lk = lock();
+    leak_report leaks;
+    auto now = std::chrono::steady_clock::now();
+    for(uint32_t slot = 0; slot < nodes.size(); ++slot)
+    {
+        const dependency_info& info = nodes[slot];
+        const node_state& state = node_states[slot];
+        if(!info.resource)
+            continue;
+        // Idle pooled resources aren't leaks until the GC goes away.
+        bool pooled = state.kind == NODE_RECYCLABLE && recycle_infos[info.owner].pooled;
+        if(!final_report && pooled)
+            continue;
+        leak_report::resource_entry e;
+        e.resource = info.resource;
+        e.dependency_count = state.dependency_count;
+        e.pending_time = std::chrono::steady_clock::duration::zero();
+#if VKGC_CALL_SITES
+        e.depended_at = info.depended_at;
+        e.released_at = info.released_at;
+#endif
+        if(!state.released)
+            leaks.unreleased.push_back(e);
+        else
+        {
+            e.pending_time = now - info.release_time;
+            if(e.pending_time >= stale_threshold)
+                leaks.stale.push_back(e);
+        }
+    }
+
+    for(uint32_t slot = 0; slot < semaphore_infos.size(); ++slot)
+    {
+        const semaphore_info& info = semaphore_infos[slot];
+        if(info.handle == VK_NULL_HANDLE)
+            continue;
+        leak_report::semaphore_entry e;
+        e.timeline = info.handle;
+        e.released = info.should_destroy;
+        e.pending_triggers = info.triggers.size();
+        e.next_value = info.triggers.empty() ? 0 : info.triggers.front().value;
+        e.stalled_time = info.triggers.empty() ?
+            std::chrono::steady_clock::duration::zero() :
+            now - info.last_progress;
+#if VKGC_CALL_SITES
+        e.depended_at = info.depended_at;
+        e.released_at = info.released_at;
+#endif
+        if(final_report || (e.pending_triggers != 0 && e.stalled_time >= stale_threshold))
+            leaks.semaphores.push_back(e);
+    }
+    return leaks;
+}
+
+#if VKGC_TRACING
+template<typename Traits>
+bool basic_garbage_collector<Traits>::start_recording(const char* path)
+{
+    std::FILE* f = std::fopen(path, "wb");
+    if(!f)
+        return false;
+
+    std::unique_lock<lock_type> lk = lock();
+    recorder.reset(new trace_writer(f));
+    return true;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::stop_recording()
+{
+    std::unique_lock<lock_type> lk = lock();
+    recorder.reset();
+}
+#endif
+
+#if VKGC_STATS
+template<typename Traits>
+typename basic_garbage_collector<Traits>::statistics basic_garbage_collector<Traits>::get_statistics()
+{
+    std::unique_lock<lock_type> lk(mutex);
+    return stats;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::reset_statistics()
+{
+    std::unique_lock<lock_type> lk(mutex);
+    stats = {};
+}
+#endif
+
+template<typename Traits>
+std::unique_lock<typename basic_garbage_collector<Traits>::lock_type> basic_garbage_collector<Traits>::lock()
+{
+#if VKGC_STATS
+    std::unique_lock<lock_type> lk(mutex, std::try_to_lock);
+    if(!lk.owns_lock())
+    {
+        auto start = std::chrono::steady_clock::now();
+        lk.lock();
+        stats.lock_contentions++;
+        stats.lock_wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start
+        ).count();
+    }
+    stats.lock_acquisitions++;
+    return lk;
+#else
+    return std::unique_lock<lock_type>(mutex);
+#endif
+}
+
+template<typename Traits>
+uint32_t basic_garbage_collector<Traits>::get_slot(void* resource, const call_site& site)
+{
+    auto it = resources.find(resource);
+    if(it != resources.end())
+        return it->second;
+
+    uint32_t slot = nodes.acquire();
+    if(slot == node_states.size())
+        node_states.emplace_back();
+    resources.emplace(resource, slot);
+    dependency_info& info = nodes[slot];
+    info.resource = resource;
+#if VKGC_CALL_SITES
+    info.depended_at = site;
+    info.released_at = call_site();
+#endif
+    (void)site;
+    return slot;
+}
+
+template<typename Traits>
+uint32_t basic_garbage_collector<Traits>::get_slot(resource_id id)
+{
+    uint32_t slot = id.value & ((1u << id_slot_bits) - 1);
+    if(slot >= nodes.size())
+        return none;
+    if(node_states[slot].generation != id.value >> id_slot_bits || !nodes[slot].resource)
+        return none;
+    return slot;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::add_edge(uint32_t& head, uint32_t used_slot)
+{
+    if(head == none || edge_blocks[head].count == edge_block::capacity)
+    {
+        uint32_t slot = edge_blocks.acquire();
+        edge_blocks[slot].count = 0;
+        edge_blocks[slot].next = head;
+        head = slot;
+    }
+    edge_block& block = edge_blocks[head];
+    block.used[block.count++] = used_slot;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::add_dependency(uint32_t used_slot, uint32_t user_slot)
+{
+    node_states[used_slot].dependency_count++;
+    add_edge(nodes[user_slot].edges, used_slot);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release_node(
+    uint32_t slot,
+    std::function<void()>&& cleanup,
+    const call_site& site
+){
+    // Without a cleanup, there'd be nothing to run once it's unused.
+    if(!cleanup)
+        return;
+    dependency_info& info = nodes[slot];
+    node_state& state = node_states[slot];
+    info.cleanup = std::move(cleanup);
+    state.released = true;
+    info.release_time = std::chrono::steady_clock::now();
+#if VKGC_CALL_SITES
+    info.released_at = site;
+#endif
+    (void)site;
+    // An acquired resource may be released for good.
+    if(state.kind == NODE_RECYCLABLE)
+    {
+        recycle_infos.release(info.owner);
+        info.owner = none;
+        state.kind = NODE_CLEANUP;
+    }
+#if VKGC_TRACING
+    if(recorder)
+    {
+        recorder->begin(TRACE_RELEASE);
+        recorder->resource((uint64_t)info.resource);
+    }
+#endif
+    check_delete(slot);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::free_edges(uint32_t head)
+{
+    while(head != none)
+    {
+        uint32_t next = edge_blocks[head].next;
+        edge_blocks.release(head);
+        head = next;
+    }
+}
+
+template<typename Traits>
+template<typename F>
+void basic_garbage_collector<Traits>::for_each_edge(uint32_t head, F&& f)
+{
+    for(uint32_t slot = head; slot != none; slot = edge_blocks[slot].next)
+    {
+        edge_block& block = edge_blocks[slot];
+        for(uint32_t i = 0; i < block.count; ++i)
+            f(block.used[i]);
+    }
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::free_node(uint32_t slot)
+{
+    dependency_info& info = nodes[slot];
+    node_state& state = node_states[slot];
+    free_edges(info.edges);
+    if(state.kind == NODE_RECYCLABLE)
+        recycle_infos.release(info.owner);
+    info.resource = nullptr;
+    info.edges = none;
+    info.owner = none;
+    info.secondary = false;
+    state.dependency_count = 0;
+    state.kind = NODE_CLEANUP;
+    state.released = false;
+    if(next_generation(slot))
+        nodes.release(slot);
+}
+
+template<typename Traits>
+bool basic_garbage_collector<Traits>::next_generation(uint32_t slot)
+{
+    // Without an id, nothing can refer to the old resource.
+    dependency_info& info = nodes[slot];
+    if(!info.has_id)
+        return true;
+    info.has_id = false;
+    if(++node_states[slot].generation != 0)
+        return true;
+    info.retired = true;
+    return false;
+}
+
+template<typename Traits>
+typename basic_garbage_collector<Traits>::semaphore_info& basic_garbage_collector<Traits>::get_semaphore(
+    VkSemaphore sem,
+    const call_site& site
+){
+    auto it = semaphore_dependencies.find(sem);
+    if(it != semaphore_dependencies.end())
+        return semaphore_infos[it->second];
+
+    uint32_t slot = semaphore_infos.acquire(alloc);
+    semaphore_dependencies.emplace(sem, slot);
+    semaphore_info& info = semaphore_infos[slot];
+    info.handle = sem;
+#if VKGC_CALL_SITES
+    info.depended_at = site;
+    info.released_at = call_site();
+#endif
+    (void)site;
+    return info;
+}
+
+template<typename Traits>
+bool basic_garbage_collector<Traits>::reached(VkSemaphore timeline, uint64_t value)
+{
+    // Null semaphores have nothing to wait for.
+    if(timeline == VK_NULL_HANDLE)
+        return true;
+    auto it = semaphore_dependencies.find(timeline);
+    return it != semaphore_dependencies.end() && semaphore_infos[it->second].last_value >= value;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::push_trigger(
+    semaphore_info& sem,
+    uint64_t value,
+    uint32_t dependent,
+    std::function<void()>&& callback,
+    uint32_t group
+){
+    if(sem.triggers.empty())
+        sem.last_progress = std::chrono::steady_clock::now();
+
+    uint32_t slot = trigger_infos.acquire();
+    trigger_info& t = trigger_infos[slot];
+    t.dependent = dependent;
+    t.group = group;
+    t.callback = std::move(callback);
+    sem.triggers.push_back({value, slot});
+    std::push_heap(sem.triggers.begin(), sem.triggers.end());
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::fire_trigger(uint32_t slot)
+{
+    trigger_info& t = trigger_infos[slot];
+    if(t.callback)
+    {
+        t.callback();
+        t.callback = nullptr;
+    }
+    if(t.dependent != none)
+    {
+        node_states[t.dependent].dependency_count--;
+        check_delete(t.dependent);
+        t.dependent = none;
+    }
+    if(t.group != none)
+    {
+        for_each_edge(t.group, [this](uint32_t dep){
+            node_states[dep].dependency_count--;
+            check_delete(dep);
+        });
+        free_edges(t.group);
+        t.group = none;
+    }
+    trigger_infos.release(slot);
+}
+
+template<typename Traits>
+VkResult basic_garbage_collector<Traits>::wait_pending(uint64_t timeout)
+{
+    VkResult res = VK_SUCCESS;
+    auto start = std::chrono::steady_clock::now();
+    if(!wait_semaphores.empty())
+    {
+#if VKGC_TRACING
+        if(recorder)
+            recorder->begin(TRACE_WAIT_IDLE);
+#endif
+        VkSemaphoreWaitInfo info = {
+            VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+            nullptr,
+            0,
+            (uint32_t)wait_semaphores.size(),
+            wait_semaphores.data(),
+            wait_values.data()
+        };
+        res = vk.vkWaitSemaphores(dev, &info, timeout);
+    }
+    if(res == VK_SUCCESS && !fence_batch.empty())
+    {
+        uint64_t remaining = timeout;
+        if(timeout != UINT64_MAX)
+        {
+            uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start
+            ).count();
+            remaining = elapsed < timeout ? timeout - elapsed : 0;
+        }
+        res = vk.vkWaitForFences(
+            dev, (uint32_t)fence_batch.size(), fence_batch.data(), VK_TRUE, remaining
+        );
+    }
+    return res;
+}
+
+template<typename Traits>
+uint32_t basic_garbage_collector<Traits>::get_fence(VkFence fence)
+{
+    auto it = fence_dependencies.find(fence);
+    if(it != fence_dependencies.end())
+        return it->second;
+
+    uint32_t slot = fence_infos.acquire(alloc);
+    fence_dependencies.emplace(fence, slot);
+    fence_infos[slot].handle = fence;
+    return slot;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::poll_fences()
+{
+    // There's no batched vkGetFenceStatus(), but a zero-timeout wait for any
+    // of them tells if checking them one by one is worth it.
+    if(fence_dependencies.size() > 1)
+    {
+        fence_batch.clear();
+        for(uint32_t slot = 0; slot < fence_infos.size(); ++slot)
+            if(fence_infos[slot].handle != VK_NULL_HANDLE)
+                fence_batch.push_back(fence_infos[slot].handle);
+        VkResult res = vk.vkWaitForFences(
+            dev, (uint32_t)fence_batch.size(), fence_batch.data(), VK_FALSE, 0
+        );
+        if(res == VK_TIMEOUT)
+            return;
+    }
+
+    for(uint32_t slot = 0; slot < fence_infos.size(); ++slot)
+    {
+        VkFence handle = fence_infos[slot].handle;
+        if(handle != VK_NULL_HANDLE && vk.vkGetFenceStatus(dev, handle) == VK_SUCCESS)
+        {
+#if VKGC_TRACING
+            if(recorder)
+            {
+                recorder->begin(TRACE_OBSERVE_FENCE);
+                recorder->fence((uint64_t)handle);
+            }
+#endif
+            finish_fence(slot);
+        }
+    }
+
+    if(!fence_resets.empty())
+    {
+        vk.vkResetFences(dev, (uint32_t)fence_resets.size(), fence_resets.data());
+        idle_fences.insert(idle_fences.end(), fence_resets.begin(), fence_resets.end());
+        fence_resets.clear();
+    }
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::finish_fence(uint32_t slot)
+{
+    fence_info& info = fence_infos[slot];
+    for(uint32_t trigger_slot: info.triggers)
+        fire_trigger(trigger_slot);
+    info.triggers.clear();
+
+    if(info.state == FENCE_DESTROY)
+        vk.vkDestroyFence(dev, info.handle, nullptr);
+    else if(info.state == FENCE_RECYCLE)
+        fence_resets.push_back(info.handle);
+    fence_dependencies.erase(fence_dependencies.find(info.handle));
+    info.handle = VK_NULL_HANDLE;
+    info.state = FENCE_IN_USE;
+    fence_infos.release(slot);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::release_queues()
+{
+    for(uint32_t slot = 0; slot < queue_infos.size(); ++slot)
+    {
+        queue_info& q = queue_infos[slot];
+        if(q.queue == VK_NULL_HANDLE)
+            continue;
+        // Submits without command buffers have no trigger, but the timeline
+        // must outlive their signals too.
+        semaphore_info& sem = get_semaphore(q.timeline, call_site());
+        if(sem.last_value < q.value)
+            push_trigger(sem, q.value, none, nullptr);
+        sem.should_destroy = true;
+        queues.erase(queues.find(q.queue));
+        q.queue = VK_NULL_HANDLE;
+        q.timeline = VK_NULL_HANDLE;
+        q.value = 0;
+        queue_infos.release(slot);
+    }
+}
+
+template<typename Traits>
+bool basic_garbage_collector<Traits>::trigger::operator<(const trigger& t) const
+{
+    return t.value < value;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::check_delete(uint32_t slot)
+{
+    const node_state& state = node_states[slot];
+    if(state.dependency_count != 0 || !state.released)
+        return;
+
+    if(state.kind == NODE_RECYCLABLE)
+    {
+        if(!recycle_infos[nodes[slot].owner].pooled)
+            pool_resource(slot);
+        return;
+    }
+
+    cascade.push_back(slot);
+    if(cascading)
+        return;
+    cascading = true;
+    while(!cascade.empty())
+    {
+        uint32_t ready = cascade.back();
+        cascade.pop_back();
+        resources.erase(resources.find(nodes[ready].resource));
+        destroy(ready);
+    }
+    cascading = false;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::destroy(uint32_t slot)
+{
+    dependency_info& info = nodes[slot];
+    node_kind kind = node_states[slot].kind;
+    if(kind == NODE_COMMAND_BUFFER)
+    {
+        // Only the thread owning the pool may touch it, so the command buffer
+        // just waits on the ready list until it's acquired again.
+        command_pool_info& p = command_pool_infos[info.owner];
+        p.ready[info.secondary].push_back((VkCommandBuffer)info.resource);
+        p.pending--;
+        check_destroy_command_pool(info.owner);
+    }
+    else if(kind == NODE_DESCRIPTOR_SET)
+    {
+        descriptor_pool_infos[info.owner].pending--;
+        check_descriptor_pool(info.owner);
+    }
+    else if(info.cleanup)
+        info.cleanup();
+    info.cleanup = nullptr;
+    for_each_edge(info.edges, [this](uint32_t dep){
+        node_states[dep].dependency_count--;
+        check_delete(dep);
+    });
+    free_node(slot);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::pool_resource(uint32_t node_slot)
+{
+    uint32_t slot = nodes[node_slot].owner;
+    recycle_info& r = recycle_infos[slot];
+    r.pooled = true;
+    r.pooled_time = std::chrono::steady_clock::now();
+
+    r.key_prev = none;
+    auto it = recycle_keys.find(r.key);
+    if(it == recycle_keys.end())
+    {
+        r.key_next = none;
+        recycle_keys.emplace(r.key, slot);
+    }
+    else
+    {
+        r.key_next = it->second;
+        recycle_infos[it->second].key_prev = slot;
+        it->second = slot;
+    }
+
+    r.newer = none;
+    r.older = newest_pooled;
+    if(newest_pooled != none)
+        recycle_infos[newest_pooled].newer = slot;
+    else oldest_pooled = slot;
+    newest_pooled = slot;
+
+    pooled_bytes += r.size;
+    while(pooled_bytes > recycle_max_bytes && oldest_pooled != none)
+        evict(oldest_pooled);
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::unpool(uint32_t slot)
+{
+    recycle_info& r = recycle_infos[slot];
+    if(r.key_prev != none)
+        recycle_infos[r.key_prev].key_next = r.key_next;
+    else if(r.key_next != none)
+        recycle_keys.find(r.key)->second = r.key_next;
+    else recycle_keys.erase(recycle_keys.find(r.key));
+    if(r.key_next != none)
+        recycle_infos[r.key_next].key_prev = r.key_prev;
+
+    if(r.newer != none)
+        recycle_infos[r.newer].older = r.older;
+    else newest_pooled = r.older;
+    if(r.older != none)
+        recycle_infos[r.older].newer = r.newer;
+    else oldest_pooled = r.newer;
+
+    pooled_bytes -= r.size;
+    r.pooled = false;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::evict(uint32_t slot)
+{
+    unpool(slot);
+    uint32_t node_slot = recycle_infos[slot].node;
+    resources.erase(resources.find(nodes[node_slot].resource));
+    destroy(node_slot);
+}
+
+template<typename Traits>
+uint32_t basic_garbage_collector<Traits>::get_command_pool(VkCommandPool pool)
+{
+    auto it = command_pools.find(pool);
+    if(it != command_pools.end())
+        return it->second;
+
+    uint32_t slot = command_pool_infos.acquire(alloc);
+    command_pools.emplace(pool, slot);
+    command_pool_infos[slot].pool = pool;
+    return slot;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::check_destroy_command_pool(uint32_t slot)
+{
+    command_pool_info& p = command_pool_infos[slot];
+    if(!p.should_destroy || p.pending != 0 || p.recording != 0)
+        return;
+
+    // Destroying the pool frees its command buffers too.
+    vk.vkDestroyCommandPool(dev, p.pool, nullptr);
+    command_pools.erase(command_pools.find(p.pool));
+    p.pool = VK_NULL_HANDLE;
+    p.should_destroy = false;
+    for(int i = 0; i < 2; ++i)
+    {
+        p.ready[i].clear();
+        p.clean[i].clear();
+    }
+    command_pool_infos.release(slot);
+}
+
+template<typename Traits>
+uint32_t basic_garbage_collector<Traits>::get_descriptor_pool(VkDescriptorPool pool)
+{
+    auto it = descriptor_pools.find(pool);
+    if(it != descriptor_pools.end())
+        return it->second;
+
+    uint32_t slot = descriptor_pool_infos.acquire();
+    descriptor_pools.emplace(pool, slot);
+    descriptor_pool_infos[slot].pool = pool;
+    return slot;
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::check_descriptor_pool(uint32_t slot)
+{
+    descriptor_pool_info& p = descriptor_pool_infos[slot];
+    if(p.pending != 0)
+        return;
+
+    if(p.state == POOL_DESTROY)
+        destroy_descriptor_pool(slot);
+    else if(p.state == POOL_RECYCLE)
+    {
+        if(vk.vkResetDescriptorPool(dev, p.pool, 0) != VK_SUCCESS)
+        {
+            destroy_descriptor_pool(slot);
+            return;
+        }
+        p.state = POOL_IDLE;
+        auto it = idle_descriptor_pools.find(p.key);
+        if(it == idle_descriptor_pools.end())
+        {
+            p.next_idle = none;
+            idle_descriptor_pools.emplace(p.key, slot);
+        }
+        else
+        {
+            p.next_idle = it->second;
+            it->second = slot;
+        }
+    }
+}
+
+template<typename Traits>
+void basic_garbage_collector<Traits>::destroy_descriptor_pool(uint32_t slot)
+{
+    descriptor_pool_info& p = descriptor_pool_infos[slot];
+    vk.vkDestroyDescriptorPool(dev, p.pool, nullptr);
+    descriptor_pools.erase(descriptor_pools.find(p.pool));
+    p.pool = VK_NULL_HANDLE;
+    p.state = POOL_IN_USE;
+    p.next_idle = none;
+    descriptor_pool_infos.release(slot);
+}
+
+#ifndef VKGC_HEADER_ONLY
+extern template class basic_garbage_collector<default_traits>;
+#endif
+
+}
+
+#endif
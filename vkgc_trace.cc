@@ -0,0 +1,215 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+#include "vkgc_trace.hh"
+#include <cstring>
+
+#ifdef VKGC_HEADER_ONLY
+#define VKGC_TRACE_INLINE inline
+#else
+#define VKGC_TRACE_INLINE
+#endif
+
+namespace vkgc
+{
+
+VKGC_TRACE_INLINE trace_writer::trace_writer(std::FILE* f)
+: f(f), last_time(std::chrono::steady_clock::now())
+{
+    buffer.reserve(1 << 16);
+    buffer.insert(buffer.end(), trace_magic, trace_magic + sizeof(trace_magic));
+    fence_ids.emplace(0, 0);
+}
+
+VKGC_TRACE_INLINE trace_writer::~trace_writer()
+{
+    flush();
+    std::fclose(f);
+}
+
+VKGC_TRACE_INLINE void trace_writer::begin(trace_op op)
+{
+    if(buffer.size() >= (1 << 16) - 64)
+        flush();
+
+    auto now = std::chrono::steady_clock::now();
+    buffer.push_back(op);
+    varint(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_time).count());
+    last_time = now;
+
+    auto it = threads.emplace(std::this_thread::get_id(), threads.size()).first;
+    varint(it->second);
+}
+
+VKGC_TRACE_INLINE void trace_writer::resource(uint64_t handle)
+{
+    id(resource_ids, handle);
+}
+
+VKGC_TRACE_INLINE void trace_writer::semaphore(uint64_t handle)
+{
+    id(semaphore_ids, handle);
+}
+
+VKGC_TRACE_INLINE void trace_writer::fence(uint64_t handle)
+{
+    id(fence_ids, handle);
+}
+
+VKGC_TRACE_INLINE void trace_writer::command_pool(uint64_t handle)
+{
+    id(command_pool_ids, handle);
+}
+
+VKGC_TRACE_INLINE void trace_writer::descriptor_pool(uint64_t handle)
+{
+    id(descriptor_pool_ids, handle);
+}
+
+VKGC_TRACE_INLINE void trace_writer::queue(uint64_t handle)
+{
+    id(queue_ids, handle);
+}
+
+VKGC_TRACE_INLINE void trace_writer::value(uint64_t value)
+{
+    varint(value);
+}
+
+VKGC_TRACE_INLINE void trace_writer::observe(uint64_t semaphore, uint64_t value)
+{
+    auto it = observed.find(semaphore);
+    if(it != observed.end() && it->second == value)
+        return;
+    observed[semaphore] = value;
+    begin(TRACE_OBSERVE);
+    this->semaphore(semaphore);
+    this->value(value);
+}
+
+VKGC_TRACE_INLINE void trace_writer::flush()
+{
+    std::fwrite(buffer.data(), 1, buffer.size(), f);
+    buffer.clear();
+}
+
+VKGC_TRACE_INLINE void trace_writer::varint(uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        buffer.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    buffer.push_back(uint8_t(value));
+}
+
+VKGC_TRACE_INLINE void trace_writer::id(
+    std::unordered_map<uint64_t, uint64_t>& ids,
+    uint64_t handle
+){
+    varint(ids.emplace(handle, ids.size()).first->second);
+}
+
+VKGC_TRACE_INLINE trace_reader::trace_reader(const uint8_t* data, size_t size)
+: data(data), end(data + size), time_ns(0), ok(true)
+{
+    if(size < sizeof(trace_magic) || std::memcmp(data, trace_magic, sizeof(trace_magic)))
+    {
+        ok = false;
+        this->data = end;
+    }
+    else this->data += sizeof(trace_magic);
+}
+
+VKGC_TRACE_INLINE bool trace_reader::valid() const
+{
+    return ok;
+}
+
+VKGC_TRACE_INLINE bool trace_reader::at_end() const
+{
+    return data == end;
+}
+
+VKGC_TRACE_INLINE trace_op trace_reader::peek() const
+{
+    return data == end ? TRACE_OP_COUNT : trace_op(*data);
+}
+
+VKGC_TRACE_INLINE bool trace_reader::next(record& r)
+{
+    if(data == end)
+        return false;
+
+    r.op = trace_op(*data++);
+    if(r.op == 0 || r.op >= TRACE_OP_COUNT)
+    {
+        ok = false;
+        data = end;
+        return false;
+    }
+    time_ns += read();
+    r.time_ns = time_ns;
+    r.thread = read();
+    return ok;
+}
+
+VKGC_TRACE_INLINE uint64_t trace_reader::read()
+{
+    uint64_t value = 0;
+    for(unsigned shift = 0; shift < 64; shift += 7)
+    {
+        if(data == end)
+        {
+            ok = false;
+            return 0;
+        }
+        uint8_t byte = *data++;
+        value |= uint64_t(byte & 0x7F) << shift;
+        if(!(byte & 0x80))
+            return value;
+    }
+    ok = false;
+    return value;
+}
+
+VKGC_TRACE_INLINE void trace_reader::skip(trace_op op)
+{
+    // Variable-length records end their fixed arguments with the count of
+    // the rest.
+    static const uint8_t fixed_args[TRACE_OP_COUNT] = {
+        0, 2, 2, 3, 1, 1, 2, 0, 2, 0, 3, 1,
+        3, 4, 1, 2, 2, 1, 1, 2, 1, 1, 1, 1, 1, 5
+    };
+    uint64_t count = 0;
+    for(unsigned i = 0; ok && i < fixed_args[op]; ++i)
+        count = read();
+    if(op == TRACE_DEPEND_MANY || op == TRACE_SUBMIT)
+        for(uint64_t i = 0; ok && i < count; ++i)
+            read();
+}
+
+}
@@ -0,0 +1,186 @@
+/*
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <https://unlicense.org>
+*/
+#ifndef VKGC_TRACE_HH
+#define VKGC_TRACE_HH
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace vkgc
+{
+
+// Call traces start with this 8-byte header. Every record after it is an
+// opcode byte followed by LEB128 varints: the nanoseconds since the previous
+// record, a dense thread id and then the arguments of the call. Handles are
+// remapped to dense ids in the order they're first seen, separately for each
+// object type, as handles of different types may have the same value. Command
+// buffers and descriptor sets are resources. Fence id 0 is VK_NULL_HANDLE.
+static const char trace_magic[8] = {'V', 'K', 'G', 'C', 'T', 'R', 'C', 1};
+
+enum trace_op: uint8_t
+{
+    // used, user
+    TRACE_DEPEND = 1,
+    // user, count, used...
+    TRACE_DEPEND_MANY,
+    // used, semaphore, value
+    TRACE_DEPEND_TIMELINE,
+    // resource
+    TRACE_RELEASE,
+    // semaphore
+    TRACE_RELEASE_SEMAPHORE,
+    // semaphore, value
+    TRACE_ADD_TRIGGER,
+    // (nothing)
+    TRACE_COLLECT,
+    // semaphore, value; written when collect() sees a new counter value.
+    TRACE_OBSERVE,
+    // (nothing); written for the blocking wait in wait_collect().
+    TRACE_WAIT_IDLE,
+    // resource, key, size
+    TRACE_RELEASE_RECYCLABLE,
+    // key
+    TRACE_ACQUIRE,
+    // command buffer, command pool, level
+    TRACE_RELEASE_COMMAND_BUFFER,
+    // command pool, level, pool flags, command buffer; the command buffer is
+    // the one that was returned.
+    TRACE_ACQUIRE_COMMAND_BUFFER,
+    // command pool
+    TRACE_RELEASE_COMMAND_POOL,
+    // descriptor set, descriptor pool
+    TRACE_RELEASE_DESCRIPTOR_SET,
+    // descriptor pool, key
+    TRACE_RELEASE_RECYCLABLE_DESCRIPTOR_POOL,
+    // key
+    TRACE_ACQUIRE_DESCRIPTOR_POOL,
+    // descriptor pool
+    TRACE_RELEASE_DESCRIPTOR_POOL,
+    // used, fence
+    TRACE_DEPEND_FENCE,
+    // fence
+    TRACE_ADD_FENCE_TRIGGER,
+    // fence
+    TRACE_RELEASE_FENCE,
+    // fence
+    TRACE_RELEASE_RECYCLABLE_FENCE,
+    // fence; the one that was returned.
+    TRACE_ACQUIRE_FENCE,
+    // fence; written when collect() finds the fence signaled.
+    TRACE_OBSERVE_FENCE,
+    // queue, timeline semaphore, value, fence, count, command buffer...; the
+    // internal timeline of the queue and the value it signals.
+    TRACE_SUBMIT,
+    TRACE_OP_COUNT
+};
+
+// Records a call trace into a file, see garbage_collector::start_recording().
+// Not thread-safe, the GC calls this with its mutex held.
+class trace_writer
+{
+public:
+    // Takes ownership of 'f' and writes the header.
+    explicit trace_writer(std::FILE* f);
+    trace_writer(const trace_writer&) = delete;
+    ~trace_writer();
+
+    // Starts a new record. The arguments follow with resource(), semaphore()
+    // and the like, and value().
+    void begin(trace_op op);
+    void resource(uint64_t handle);
+    void semaphore(uint64_t handle);
+    void fence(uint64_t handle);
+    void command_pool(uint64_t handle);
+    void descriptor_pool(uint64_t handle);
+    void queue(uint64_t handle);
+    void value(uint64_t value);
+
+    // Writes a TRACE_OBSERVE record if the value differs from the previously
+    // observed one.
+    void observe(uint64_t semaphore, uint64_t value);
+
+    void flush();
+
+private:
+    void varint(uint64_t value);
+    void id(std::unordered_map<uint64_t, uint64_t>& ids, uint64_t handle);
+
+    std::FILE* f;
+    std::vector<uint8_t> buffer;
+    std::chrono::steady_clock::time_point last_time;
+    std::unordered_map<uint64_t /*handle*/, uint64_t /*id*/> resource_ids;
+    std::unordered_map<uint64_t /*handle*/, uint64_t /*id*/> semaphore_ids;
+    std::unordered_map<uint64_t /*handle*/, uint64_t /*id*/> fence_ids;
+    std::unordered_map<uint64_t /*handle*/, uint64_t /*id*/> command_pool_ids;
+    std::unordered_map<uint64_t /*handle*/, uint64_t /*id*/> descriptor_pool_ids;
+    std::unordered_map<uint64_t /*handle*/, uint64_t /*id*/> queue_ids;
+    std::unordered_map<std::thread::id, uint64_t> threads;
+    std::unordered_map<uint64_t /*semaphore*/, uint64_t /*value*/> observed;
+};
+
+// Parses a call trace from memory.
+class trace_reader
+{
+public:
+    struct record
+    {
+        trace_op op;
+        // Nanoseconds since the start of the trace.
+        uint64_t time_ns;
+        uint64_t thread;
+    };
+
+    trace_reader(const uint8_t* data, size_t size);
+
+    // False if the header is wrong or a record was truncated.
+    bool valid() const;
+    bool at_end() const;
+
+    // Opcode of the next record, without consuming it.
+    trace_op peek() const;
+
+    // Reads the next record header. Its arguments must then be read with
+    // read(), in the order listed in trace_op.
+    bool next(record& r);
+    uint64_t read();
+    // Reads past the arguments of the record instead.
+    void skip(trace_op op);
+
+private:
+    const uint8_t* data;
+    const uint8_t* end;
+    uint64_t time_ns;
+    bool ok;
+};
+
+}
+
+#endif